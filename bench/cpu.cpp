@@ -0,0 +1,130 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <array>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Bus.h"
+#include "mappers/NROM.h"
+
+using std::uint64_t;
+using std::uint16_t;
+using std::uint8_t;
+
+/**
+ * CPU BENCHMARK
+ *
+ * Measures instructions per second through Bus::tick, which every revision of the bus has, so 
+ * the same benchmark can be built against an older tree, see the Makefile. Trees with Bus::run
+ * are measured through it as well, and with translated blocks if the tree has them. The program is a 
+ * random stream of official and unofficial instructions in a loop. The instructions only write 
+ * the zero page below the pointers and the stack, and only read RAM and PRG-ROM, so the stream
+ * runs the same on every tree. The loop counts its iterations in RAM, from which the number of
+ * instructions run is known.
+ */
+
+namespace {
+    constexpr std::size_t INSTRUCTIONS = 1000; // Random instructions in the loop.
+    constexpr uint64_t CYCLES = 30000000; // CPU cycles to run.
+    constexpr uint16_t START = 0x8000;
+    constexpr uint16_t COUNTER = 0x07F0; // Iterations of the loop.
+    constexpr uint8_t POINTERS = 0xF0; // Zero page pointers into RAM, which are never written.
+
+    // Opcodes of the random instructions by their operand.
+    constexpr std::array<uint8_t, 12> IMMEDIATE = {0x09, 0x29, 0x49, 0x69, 0xE9, 0xC9, 0xE0, 0xC0, 0xA9, 0xA2, 0xA0, 0x0B};
+    constexpr std::array<uint8_t, 36> ZERO_PAGE = {
+        0x05, 0x25, 0x45, 0x65, 0xE5, 0xC5, 0xE4, 0xC4, 0xA5, 0xA6, 0xA4, 0x24, 0x06, 0x46, 0x26, 0x66, 0xE6, 0xC6, 0x85, 0x86, 
+        0x84, 0x15, 0x35, 0x55, 0x75, 0xF5, 0xD5, 0xB5, 0xB4, 0x07, 0x27, 0xC7, 0xE7, 0xA7, 0x87, 0x04
+    };
+    constexpr std::array<uint8_t, 7> INDIRECT = {0x11, 0x31, 0x51, 0x71, 0xD1, 0xF1, 0xB1};
+    constexpr std::array<uint8_t, 20> ABSOLUTE = {
+        0x0D, 0x2D, 0x4D, 0x6D, 0xED, 0xCD, 0xAD, 0xAE, 0xAC, 0x2C, 0x1D, 0x3D, 0x7D, 0xBD, 0xBC, 0x19, 0x59, 0xB9, 0xBE, 0xAF
+    };
+    constexpr std::array<uint8_t, 30> IMPLIED = {
+        0x0A, 0x4A, 0x2A, 0x6A, 0x18, 0x38, 0xB8, 0xD8, 0xE8, 0xC8, 0xCA, 0x88, 0xAA, 0xA8, 0x8A, 0x98, 0xBA, 0x48, 0x68, 0x08, 
+        0x28, 0xEA, 0x1A, 0xEA, 0xE8, 0xC8, 0xAA, 0x8A, 0x0A, 0x4A
+    };
+
+    std::vector<uint8_t> generate(std::mt19937 &random) {
+        std::vector<uint8_t> prg(0x8000, 0xEA);
+        uint16_t pc = START;
+        auto emit = [&](std::initializer_list<uint8_t> bytes) { for (uint8_t byte : bytes) prg[pc++ & 0x7FFF] = byte; };
+
+        for (std::size_t i = 0; i < INSTRUCTIONS; i++) {
+            switch (random() % 5) {
+                case 0: emit({IMMEDIATE[random() % IMMEDIATE.size()], (uint8_t)random()}); break;
+                case 1: emit({ZERO_PAGE[random() % ZERO_PAGE.size()], (uint8_t)(random() % POINTERS)}); break;
+                case 2: emit({INDIRECT[random() % INDIRECT.size()], (uint8_t)(POINTERS + (random() & 0x0E))}); break;
+                case 3: {
+                    // RAM below the counter or PRG-ROM, also when indexed.
+                    uint16_t addr = (random() & 0x01) ? 0x0300 + random() % 0x0400 : 0x8000 + random() % 0x7E00;
+                    emit({ABSOLUTE[random() % ABSOLUTE.size()], (uint8_t)(addr & 0xFF), (uint8_t)(addr >> 8)});
+                    break;
+                }
+                default: emit({IMPLIED[random() % IMPLIED.size()]}); break;
+            }
+        }
+
+        // INC COUNTER, BNE +3, INC COUNTER + 1, JMP START
+        emit({0xEE, COUNTER & 0xFF, COUNTER >> 8, 0xD0, 0x03, 0xEE, (COUNTER + 1) & 0xFF, COUNTER >> 8});
+        emit({0x4C, START & 0xFF, START >> 8});
+
+        prg[0x7FFC] = START & 0xFF;
+        prg[0x7FFD] = START >> 8;
+
+        return prg;
+    }
+
+    // Run the program through Bus::tick, or Bus::run if the bus has it and run is set, with 
+    // translated blocks if the bus has them and translation is set.
+    template <typename B>
+    void measure(char const *name, std::vector<uint8_t> const &prg, bool run, bool translation = false) {
+        constexpr bool hasRun = requires(B &bus) { bus.run(CYCLES * 3); };
+        constexpr bool hasTranslation = requires(B &bus) { bus.setTranslation(true); };
+        if (run && !hasRun) return;
+        if (translation && !hasTranslation) return;
+
+        B bus;
+        bus.insertCart(std::make_shared<NROM>(prg, std::vector<uint8_t>(0x2000), NametableLayout::VERTICAL));
+        if constexpr (hasTranslation) bus.setTranslation(translation);
+
+        // RAM is not cleared by the bus, so every run starts from the same RAM.
+        std::mt19937 random(0x0800);
+        for (uint16_t addr = 0x0000; addr < 0x0800; addr++) bus.write(addr, random());
+        for (uint16_t addr = POINTERS + 1; addr < 0x0100; addr += 2) bus.write(addr, 0x03 + random() % 0x04);
+        bus.write(COUNTER, 0x00);
+        bus.write(COUNTER + 1, 0x00);
+
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (hasRun) {
+            if (run) bus.run(CYCLES * 3);
+        }
+        if (!run) {
+            for (uint64_t tick = 0; tick < CYCLES * 3; tick++) bus.tick();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Every iteration runs the random instructions, INC, BNE and JMP, every 256:th one INC as well.
+        uint64_t iterations = bus.read(COUNTER) | (bus.read(COUNTER + 1) << 8);
+        uint64_t instructions = iterations * (INSTRUCTIONS + 3) + (iterations >> 8);
+
+        std::printf(
+            "cpu %s: %llu instructions in %.3f s, %.2f M instructions/s\n", 
+            name, (unsigned long long)instructions, seconds, instructions / seconds / 1000000.0
+        );
+    }
+}
+
+int main() {
+    std::mt19937 random(0x4E4553);
+    std::vector<uint8_t> prg = generate(random);
+
+    measure<Bus>("tick", prg, false);
+    measure<Bus>("run", prg, true);
+    measure<Bus>("run translated", prg, true, true);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <array>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Bus.h"
+#include "Screen.h"
+#include "mappers/NROM.h"
+
+using std::uint64_t;
+using std::uint16_t;
+using std::uint8_t;
+
+/**
+ * SPRITE BENCHMARK
+ *
+ * Measures frames per second of a sprite heavy scene. The 64 sprites are 8x16 and placed in 8 
+ * bands of 8, so 128 lines have 8 sprites each. Their tiles, palettes and flips are random and a
+ * quarter of them are behind the background. The background and the patterns are random as well,
+ * so most pixels are opaque. The NMI copies the sprites to OAM with DMA every frame. Like the CPU
+ * benchmark it runs through Bus::tick, and through Bus::run if the bus has it, so it can be built
+ * against an older tree.
+ */
+
+namespace {
+    constexpr uint64_t FRAMES = 300;
+    constexpr uint64_t DOTS = 341 * 262; // Dots of a frame.
+    constexpr uint16_t START = 0x8000;
+    constexpr uint16_t NMI = 0x8100;
+    constexpr uint16_t PALETTE = 0x9000;
+
+    std::vector<uint8_t> generate(std::mt19937 &random) {
+        std::vector<uint8_t> prg(0x8000, 0xEA);
+        uint16_t pc = START;
+        auto emit = [&](std::initializer_list<uint8_t> bytes) { for (uint8_t byte : bytes) prg[pc++ & 0x7FFF] = byte; };
+        auto back = [&](uint16_t target) { return (uint8_t)(target - (pc + 2)); }; // Branch offset to target.
+
+        // SEI, CLD, LDX #$FF, TXS
+        emit({0x78, 0xD8, 0xA2, 0xFF, 0x9A});
+
+        // Wait for the PPU to warm up: BIT $2002, BPL wait, twice.
+        for (uint8_t i = 0; i < 2; i++) {
+            uint16_t wait = pc;
+            emit({0x2C, 0x02, 0x20});
+            emit({0x10, back(wait)});
+        }
+
+        // Copy the palette: PPUADDR $3F00, LDX #0, LDA PALETTE,X, STA $2007, INX, CPX #$20, BNE.
+        emit({0xA9, 0x3F, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA2, 0x00});
+        uint16_t palette = pc;
+        emit({0xBD, PALETTE & 0xFF, PALETTE >> 8, 0x8D, 0x07, 0x20, 0xE8, 0xE0, 0x20});
+        emit({0xD0, back(palette)});
+
+        // Fill the first nametable with tiles 0-255: PPUADDR $2000, LDY #4, LDX #0, STX $2007, INX, BNE, DEY, BNE.
+        emit({0xA9, 0x20, 0x8D, 0x06, 0x20, 0xA9, 0x00, 0x8D, 0x06, 0x20, 0xA0, 0x04, 0xA2, 0x00});
+        uint16_t fill = pc;
+        emit({0x8E, 0x07, 0x20, 0xE8});
+        emit({0xD0, back(fill)});
+        emit({0x88});
+        emit({0xD0, back(fill)});
+
+        // No scroll, NMI on with 8x16 sprites and show the background and sprites.
+        emit({0xA9, 0x00, 0x8D, 0x05, 0x20, 0x8D, 0x05, 0x20});
+        emit({0xA9, 0xA0, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20});
+
+        // Spin.
+        emit({0x4C, (uint8_t)(pc & 0xFF), (uint8_t)(pc >> 8)});
+
+        // NMI: OAMADDR 0, DMA from page 2, RTI.
+        pc = NMI;
+        emit({0xA9, 0x00, 0x8D, 0x03, 0x20, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0x40});
+
+        for (uint16_t i = 0; i < 0x20; i++) prg[(PALETTE + i) & 0x7FFF] = random() & 0x3F;
+
+        prg[0x7FFA] = NMI & 0xFF;
+        prg[0x7FFB] = NMI >> 8;
+        prg[0x7FFC] = START & 0xFF;
+        prg[0x7FFD] = START >> 8;
+
+        return prg;
+    }
+
+    template <typename B>
+    void measure(char const *name, std::vector<uint8_t> const &prg, std::vector<uint8_t> const &chr, std::array<uint8_t, 0x100> const &oam, bool run) {
+        constexpr bool hasRun = requires(B &bus) { bus.run(FRAMES * DOTS); };
+        if (run && !hasRun) return;
+
+        B bus;
+        bus.insertCart(std::make_shared<NROM>(prg, chr, NametableLayout::VERTICAL));
+        bus.connectScreen(std::make_shared<Screen<256, 240>>());
+        for (uint16_t i = 0; i < 0x100; i++) bus.write(0x0200 + i, oam[i]);
+
+        auto start = std::chrono::steady_clock::now();
+        if constexpr (hasRun) {
+            if (run) bus.run(FRAMES * DOTS);
+        }
+        if (!run) {
+            for (uint64_t tick = 0; tick < FRAMES * DOTS; tick++) bus.tick();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("sprites %s: %llu frames in %.3f s, %.1f frames/s\n", name, (unsigned long long)FRAMES, seconds, FRAMES / seconds);
+    }
+}
+
+int main() {
+    std::mt19937 random(0x0200);
+    std::vector<uint8_t> prg = generate(random);
+
+    std::vector<uint8_t> chr(0x2000);
+    for (uint8_t &byte : chr) byte = random();
+
+    // 8 bands of 8 sprites, 28 lines apart.
+    std::array<uint8_t, 0x100> oam;
+    for (uint8_t i = 0; i < 64; i++) {
+        uint8_t band = i / 8;
+        oam[i * 4 + 0] = 8 + band * 28; // Y
+        oam[i * 4 + 1] = random(); // Tile
+        oam[i * 4 + 2] = (random() & 0xC3) | ((random() & 0x03) ? 0x00 : 0x20); // A quarter behind the background.
+        oam[i * 4 + 3] = (i % 8) * 30 + band * 2; // X
+    }
+
+    measure<Bus>("tick", prg, chr, oam, false);
+    measure<Bus>("run", prg, chr, oam, true);
+
+    return 0;
+}
@@ -22,6 +22,8 @@ class BaseController {
         // NOTE: OUT is the D0 bit from the write bus.
         // TODO: Update documentation (https://www.nesdev.org/wiki/Controller_port_pinout) is a better reference.
 
+        virtual uint8_t read() { return 0x00; } // Next bit of the stored state.
+        virtual void reload() {} // Store the current state.
         uint8_t read(uint16_t) { return clk() & 0x19; }
         void write(uint16_t, uint8_t data) { if (data & 0x01) out(); }
     protected:
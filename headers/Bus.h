@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <memory>
 #include <array>
+#include <ostream>
 
 #include "CPU.h"
 #include "PPU.h"
@@ -11,7 +12,9 @@
 #include "BaseController.h"
 #include "Mapper.h"
 #include "Screen.h"
+#include "IndexedScreen.h"
 #include "Palette.h"
+#include "Pipeline.h"
 
 using std::uint64_t;
 using std::uint16_t;
@@ -21,9 +24,10 @@ class Bus {
     public:
         Bus();
         // TODO: Add ability to step one CPU.
-        // TODO: Add ability to step one CPU instruction.
         // TODO: Add ability to step one PPU dot.
         void update(uint64_t time);
+        void run(uint64_t target); // Run until the master clock reaches target.
+        uint16_t stepInstruction();
         void pause();
         void unpause();
         void tick();
@@ -31,10 +35,41 @@ class Bus {
         void reset();
         void insertCart(std::shared_ptr<Mapper> cart);
         void connectScreen(std::shared_ptr<Screen<256, 240>> screen);
+        void connectScreen(std::shared_ptr<IndexedScreen<256, 240>> screen);
         void connectController(std::shared_ptr<BaseController> controller, uint16_t addr);
-        void setPalette(Palette palette);
+        void setPalette(Palette<> palette); // Palette of the Screen, which is always RGBA8888.
+        void setTranslation(bool translation);
+        void setIdleSkip(bool idleSkip); // Skip idle loop iterations when stepping instructions.
+        void setLineRendering(bool lineRendering); // Render whole scanlines when the PPU catches up.
+        void setSpriteIndex(bool spriteIndex); // Select sprites from an index instead of evaluating OAM.
+        void setFrameSkip(uint32_t frameSkip); // Only output every frameSkip:th frame to the screens.
+        void setFrameReuse(bool frameReuse); // Repeat the last frame on the screens when nothing changed.
+        void setPipelining(bool pipelining); // Render frames on a second thread unless CHR is writable, see Pipeline.h.
+        void setRenderWorkers(uint8_t workers); // Render bands of lines on worker threads when pipelining.
+        void mapCart();
+        void mapChr(); // Let the PPU know that the mapper switched CHR banks.
+        void mapNametables(); // Let the PPU know that the mapper switched nametable layout.
         uint8_t read(uint16_t addr);
         void write(uint16_t addr, uint8_t data);
+        uint8_t const *host(uint16_t addr); // Host memory backing addr or nullptr for memory mapped I/O.
+        void watch(uint16_t addr); // Invalidate translated code when the page containing addr is written.
+        void elapse(uint16_t cycles); // Advance the master clock by cycles run by CPU::run.
+        bool due(); // If an event is due, which stops CPU::run.
+
+        enum class Event : uint8_t {
+            NMI = 0x00, // The PPU starts vblank.
+            IRQ = 0x01, // A cartridge or the APU interrupts the CPU.
+            FRAME = 0x02 // The PPU has drawn the visible frame.
+        };
+
+        void schedule(Event event, uint64_t dots); // Schedule an event the given number of dots from now.
+        uint64_t frames(); // Frames drawn since the cartridge was inserted.
+        uint64_t time(); // Master clock in PPU dots.
+        CPU::DecodeStats decodeStats(); // Hits and misses of the pre-decode cache of the CPU.
+
+        #ifdef NES_PROFILE
+        void dumpProfile(std::ostream &out); // Write the CPU and PPU profiles as a JSON object.
+        #endif
     private:
         // TODO: Document under https://www.nesdev.org/wiki/Cycle_reference_chart
         uint64_t previousTime = 0x0000000000000000;
@@ -42,6 +77,50 @@ class Bus {
         bool paused = false;
         uint8_t cycle = 0x00; // Master clock modolo CPU * PPU master clocks / clock.
         bool cartInserted = false;
+        bool idleSkip = false;
+        uint32_t idleWindow = 0; // Dots the PPU was quiet for when the CPU was last at an idle loop.
+
+        uint16_t skipIdle(uint64_t target); // Skip iterations of an idle loop, but not past target.
+
+        /**
+         * SCHEDULER
+         * 
+         * The bus keeps a master clock counted in PPU dots. Instead of checking every component each
+         * dot, everything which has to happen at a certain time is an event with a deadline. The PPU
+         * runs until the next deadline, the events which are due are handled and the next deadlines
+         * are scheduled. Events which happen every frame, like the start of vblank, are predicted 
+         * from the position of the PPU.
+         * 
+         * The PPU lags behind the CPU and only catches up when it has to: when the CPU accesses its
+         * registers, when DMA writes to OAM, when a mapper might switch banks or when an event is due.
+         * This way the PPU runs many dots at once.
+         * 
+         * Likewise run lets the CPU run instructions, or translated blocks, until the next deadline
+         * with CPU::run, which advances the master clock after each instruction. The events which 
+         * are due and DMA are handled in between.
+         */
+
+        static constexpr uint64_t NEVER = 0xFFFFFFFFFFFFFFFF;
+
+        uint64_t clock = 0x0000000000000000; // Master clock in PPU dots.
+        uint64_t ppuClock = 0x0000000000000000; // Master clock the PPU has caught up to.
+        uint64_t deadline = NEVER; // Earliest deadline of all events.
+        std::array<uint64_t, 3> events = {NEVER, NEVER, NEVER}; // Deadline of each event.
+        uint64_t frameCount = 0x0000000000000000;
+
+        void reschedule();
+        void handleEvents();
+        void handle(Event event);
+        void runPPU(uint64_t target);
+        void sync(); // Let the PPU catch up with the CPU.
+        void tickPPU(uint32_t dots);
+
+        bool pipelining = false; // If frames are rendered by the pipeline.
+        bool pipeliningEnabled = false; // If pipelining is wanted, which writable CHR memory prevents.
+        Pipeline pipeline;
+
+        void updatePipelining(); // Start or stop the pipeline for the cartridge.
+        void follow(); // Let the renderer of the pipeline take over the state of the PPU.
 
         /**
          * MEMORY MAP
@@ -66,6 +145,33 @@ class Bus {
         std::array<std::shared_ptr<BaseController>, 2> controllers;
         std::shared_ptr<Mapper> cart;
 
+        /**
+         * PAGE TABLE
+         * 
+         * The address space is split into 256 pages of 256 bytes. A page either points directly into 
+         * host memory, like the CPU RAM and PRG-ROM, or has handlers for memory mapped I/O. This way 
+         * most reads and writes are a single indexed load or store instead of a walk through the 
+         * memory map. The cartridge pages are remapped by the mapper when it switches banks.
+         */
+
+        struct Page {
+            uint8_t *read = nullptr; // Host memory to read from or nullptr to use the read handler.
+            uint8_t *write = nullptr; // Host memory to write to or nullptr to use the write handler.
+            uint8_t (Bus::*readHandler)(uint16_t addr) = nullptr;
+            void (Bus::*writeHandler)(uint16_t addr, uint8_t data) = nullptr;
+        };
+
+        std::array<Page, 0x100> pages;
+
+        void mapPages();
+        uint8_t ppuRead(uint16_t addr);
+        void ppuWrite(uint16_t addr, uint8_t data);
+        uint8_t ioRead(uint16_t addr);
+        void ioWrite(uint16_t addr, uint8_t data);
+        uint8_t cartRead(uint16_t addr);
+        void cartWrite(uint16_t addr, uint8_t data);
+        void codeWrite(uint16_t addr, uint8_t data);
+
         /**
          * DIRECT MEMORY ACCESS (DMA)
          * 
@@ -73,6 +179,9 @@ class Bus {
          * way to transfer sprites to the PPU. DMA or direct memory access allows for halting the 
          * CPU to then transfer an entire page in RAM to the OAM memory.
          * 
+         * A DMA started by an instruction is run right after it, while the CPU is suspended. The PPU
+         * catches up before each write, so every byte lands in OAM at the dot it is written.
+         * 
          * Reference: https://www.nesdev.org/wiki/PPU_registers#OAMDMA
          */
 
@@ -84,7 +193,38 @@ class Bus {
         uint8_t dmaData = 0x00;
 
         void dmaInit(uint8_t page);
+        uint16_t dma(); // Run a DMA started by an instruction and return the cycles it took.
         void dmaTransfer();
 };
 
+// Reads and writes are defined here so that they can be inlined into the CPU.
+inline uint8_t Bus::read(uint16_t addr) {
+    Page const &page = pages[addr >> 8];
+    if (page.read) return page.read[addr & 0x00FF];
+    return (this->*page.readHandler)(addr);
+}
+
+inline void Bus::write(uint16_t addr, uint8_t data) {
+    Page const &page = pages[addr >> 8];
+    if (page.write) {
+        page.write[addr & 0x00FF] = data;
+        return;
+    }
+    (this->*page.writeHandler)(addr, data);
+}
+
+inline void Bus::elapse(uint16_t cycles) {
+    clock += cycles * 3;
+}
+
+inline bool Bus::due() {
+    return clock >= deadline;
+}
+
+inline uint8_t const *Bus::host(uint16_t addr) {
+    Page const &page = pages[addr >> 8];
+    if (!page.read) return nullptr;
+    return &page.read[addr & 0x00FF];
+}
+
 #endif // H_BUS
\ No newline at end of file
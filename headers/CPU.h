@@ -3,6 +3,11 @@
 
 #include <cstdint>
 #include <array>
+#include <memory>
+#include <vector>
+#include <ostream>
+
+#include "Profiler.h"
 
 using std::uint16_t;
 using std::uint8_t;
@@ -12,6 +17,9 @@ class Bus;
 class CPU {
     public:
         void tick();
+        uint16_t stepInstruction(); // Run the next instruction and return the cycles consumed.
+        uint64_t run(uint64_t budget); // Run instructions until the cycle budget is consumed or an event is due.
+        bool done(); // Is the CPU between instructions.
         // TODO: move to private and update delay to use enum
         void power();
         void reset();
@@ -21,7 +29,31 @@ class CPU {
         
         bool suspended = false;
         bool dmaRead = true; // Is the CPU allowing DMA to read/not write.
+        bool translation = false; // Run hot code as translated blocks.
+        bool idleDetection = false; // Track idle loops while stepping instructions.
         Bus *bus = nullptr;
+
+        struct IdleLoop {
+            bool head = false; // Is the CPU at the start of an idle loop.
+            bool confirmed = false; // Did the last iteration leave the CPU unchanged.
+            bool status = false; // Does the loop read PPUSTATUS.
+            uint16_t cycles = 0; // Cycles of the last iteration.
+        };
+
+        IdleLoop idleLoop();
+
+        struct DecodeStats {
+            uint64_t hits = 0; // Instructions found in the pre-decode cache.
+            uint64_t misses = 0; // Instructions decoded from memory.
+        };
+
+        DecodeStats decodeStats();
+
+        void invalidate(uint16_t addr); // Drop decoded instructions and blocks in the page containing addr.
+
+        #ifdef NES_PROFILE
+        void dumpProfile(std::ostream &out); // Write the profile as a JSON object.
+        #endif
     private:
 
         /**
@@ -30,13 +62,15 @@ class CPU {
         
         uint8_t wait = 0x00;
         bool oops = false;
+        bool halted = false; // Set by KIL until the CPU is powered or reset.
         uint8_t opcode = 0x00;
         uint16_t opAddr = 0x0000;
         uint8_t priority = 0x00; // triggered interrupt priority.
-        void (CPU::*addrMode)() = nullptr;
-        void (CPU::*op)() = nullptr;
         void (CPU::*delayed)() = nullptr;
 
+        void step();
+        uint16_t runInstruction(); // Run the next instruction of a CPU neither halted nor suspended.
+        uint8_t fetch(); // Fetch the next operand byte of the current instruction.
         uint8_t read(uint16_t addr);
         void write(uint16_t addr, uint8_t data);
         uint8_t pop();
@@ -78,6 +112,22 @@ class CPU {
             uint8_t status = 0b00100100;
         } p; // Status register P: NV1BDIZC
 
+        /**
+         * LAZY FLAGS
+         * 
+         * Most instructions set Z and N from their result. Instead of updating the bitfields of P each
+         * instruction stores the bytes the flags are computed from, and C, Z, V and N are only packed
+         * into P when it is read as a whole, like when it is pushed to the stack.
+         */
+
+        bool carry = false; // C
+        uint8_t zero = 0x01; // Z is set if the byte is zero.
+        uint8_t overflow = 0x00; // V is bit 7 of the byte.
+        uint8_t negative = 0x00; // N is bit 7 of the byte.
+
+        uint8_t getStatus();
+        void setStatus(uint8_t status);
+
         /**
          * CPU ADDRESSING MODES
          * 
@@ -113,7 +163,7 @@ class CPU {
 
         void ADC(); // A = A + memory + C
         void AND(); // A = A & memory
-        void ASL(); // value = value << 1
+        template <bool ACCUMULATOR = false> void ASL(); // value = value << 1
         void BCC(); // PC = PC + 2 + memory (signed)
         void BCS(); // PC = PC + 2 + memory (signed)
         void BEQ(); // PC = PC + 2 + memory (signed)
@@ -143,15 +193,15 @@ class CPU {
         void LDA(); // A = memory
         void LDX(); // X = memory
         void LDY(); // Y = memory
-        void LSR(); // value = value >> 1
+        template <bool ACCUMULATOR = false> void LSR(); // value = value >> 1
         void NOP(); // no effect
         void ORA(); // A = A | memory
         void PHA(); // ($0100 + SP) = A, SP = SP - 1
         void PHP(); // ($0100 + SP) = NV11DIZC, SP = SP - 1
         void PLA(); // SP = SP + 1, A = ($0100 + SP)
         void PLP(); // SP = SP + 1, NVxxDIZC = ($0100 + SP)
-        void ROL(); // value = value << 1 through C
-        void ROR(); // value = value >> 1 through C
+        template <bool ACCUMULATOR = false> void ROL(); // value = value << 1 through C
+        template <bool ACCUMULATOR = false> void ROR(); // value = value >> 1 through C
         void RTI(); // pull NVxxDIZC flags from stack, pull PC from stack
         void RTS(); // pull PC from stack, PC = PC + 1
         void SBC(); // A = A - memory - ~C
@@ -185,7 +235,7 @@ class CPU {
         void ISC(); // memory = memory + 1, then A = A - memory - ~C
         void KIL(); // Freezes the CPU.
         void LAS(); // A = S & memory, X = S & memory, S = S & memory
-        void LAX(); // A = memory, then X = memory or A = memory, then X = A
+        template <bool IMMEDIATE = false> void LAX(); // A = memory, then X = memory or A = memory, then X = A
         void RLA(); // value = value << 1 through C, then A = A & memory
         void RRA(); // value = value >> 1 through C, then A = A + memory + C
         void SAX(); // memory = A & X
@@ -210,25 +260,173 @@ class CPU {
             uint8_t cycles = 0;
         };
 
-        std::array<Lookup, 256> opcodes = {{
+        static constexpr std::array<Lookup, 256> opcodes = {{
         //                    X0               X1               X2               X3               X4               X5               X6               X7               X8               X9               XA               XB               XC               XD               XE               XF
-        /* 0X */ {&CPU::IMP, &CPU::BRK, 7}, {&CPU::IDX, &CPU::ORA, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::SLO, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::ORA, 3}, {&CPU::ZP0, &CPU::ASL, 5}, {&CPU::ZP0, &CPU::SLO, 5}, {&CPU::IMP, &CPU::PHP, 3}, {&CPU::IMM, &CPU::ORA, 2}, {&CPU::ACC, &CPU::ASL, 2}, {&CPU::IMM, &CPU::ANC, 2}, {&CPU::ABS, &CPU::NOP, 4}, {&CPU::ABS, &CPU::ORA, 4}, {&CPU::ABS, &CPU::ASL, 6}, {&CPU::ABS, &CPU::SLO, 6},
+        /* 0X */ {&CPU::IMP, &CPU::BRK, 7}, {&CPU::IDX, &CPU::ORA, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::SLO, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::ORA, 3}, {&CPU::ZP0, &CPU::ASL, 5}, {&CPU::ZP0, &CPU::SLO, 5}, {&CPU::IMP, &CPU::PHP, 3}, {&CPU::IMM, &CPU::ORA, 2}, {&CPU::ACC, &CPU::ASL<true>, 2}, {&CPU::IMM, &CPU::ANC, 2}, {&CPU::ABS, &CPU::NOP, 4}, {&CPU::ABS, &CPU::ORA, 4}, {&CPU::ABS, &CPU::ASL, 6}, {&CPU::ABS, &CPU::SLO, 6},
         /* 1X */ {&CPU::REL, &CPU::BPL, 2}, {&CPU::IDY, &CPU::ORA, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::SLO, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::ORA, 4}, {&CPU::ZPX, &CPU::ASL, 6}, {&CPU::ZPX, &CPU::SLO, 6}, {&CPU::IMP, &CPU::CLC, 2}, {&CPU::ABY, &CPU::ORA, 4}, {&CPU::ACC, &CPU::NOP, 2}, {&CPU::ABY, &CPU::SLO, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::ORA, 4}, {&CPU::ABX, &CPU::ASL, 7}, {&CPU::ABX, &CPU::SLO, 7},
-        /* 2X */ {&CPU::ABS, &CPU::JSR, 6}, {&CPU::IDX, &CPU::AND, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::RLA, 8}, {&CPU::ZP0, &CPU::BIT, 3}, {&CPU::ZP0, &CPU::AND, 3}, {&CPU::ZP0, &CPU::ROL, 5}, {&CPU::ZP0, &CPU::RLA, 5}, {&CPU::IMP, &CPU::PLP, 4}, {&CPU::IMM, &CPU::AND, 2}, {&CPU::ACC, &CPU::ROL, 2}, {&CPU::IMM, &CPU::ANC, 2}, {&CPU::ABS, &CPU::BIT, 4}, {&CPU::ABS, &CPU::AND, 4}, {&CPU::ABS, &CPU::ROL, 6}, {&CPU::ABS, &CPU::RLA, 6},
+        /* 2X */ {&CPU::ABS, &CPU::JSR, 6}, {&CPU::IDX, &CPU::AND, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::RLA, 8}, {&CPU::ZP0, &CPU::BIT, 3}, {&CPU::ZP0, &CPU::AND, 3}, {&CPU::ZP0, &CPU::ROL, 5}, {&CPU::ZP0, &CPU::RLA, 5}, {&CPU::IMP, &CPU::PLP, 4}, {&CPU::IMM, &CPU::AND, 2}, {&CPU::ACC, &CPU::ROL<true>, 2}, {&CPU::IMM, &CPU::ANC, 2}, {&CPU::ABS, &CPU::BIT, 4}, {&CPU::ABS, &CPU::AND, 4}, {&CPU::ABS, &CPU::ROL, 6}, {&CPU::ABS, &CPU::RLA, 6},
         /* 3X */ {&CPU::REL, &CPU::BMI, 2}, {&CPU::IDY, &CPU::AND, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::RLA, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::AND, 4}, {&CPU::ZPX, &CPU::ROL, 6}, {&CPU::ZPX, &CPU::RLA, 6}, {&CPU::IMP, &CPU::SEC, 2}, {&CPU::ABY, &CPU::AND, 4}, {&CPU::ACC, &CPU::NOP, 2}, {&CPU::ABY, &CPU::RLA, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::AND, 4}, {&CPU::ABX, &CPU::ROL, 7}, {&CPU::ABX, &CPU::RLA, 7},
-        /* 4X */ {&CPU::IMP, &CPU::RTI, 6}, {&CPU::IDX, &CPU::EOR, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::SRE, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::EOR, 3}, {&CPU::ZP0, &CPU::LSR, 5}, {&CPU::ZP0, &CPU::SRE, 5}, {&CPU::IMP, &CPU::PHA, 3}, {&CPU::IMM, &CPU::EOR, 2}, {&CPU::ACC, &CPU::LSR, 2}, {&CPU::IMM, &CPU::ALR, 2}, {&CPU::ABS, &CPU::JMP, 3}, {&CPU::ABS, &CPU::EOR, 4}, {&CPU::ABS, &CPU::LSR, 6}, {&CPU::ABS, &CPU::SRE, 6},
+        /* 4X */ {&CPU::IMP, &CPU::RTI, 6}, {&CPU::IDX, &CPU::EOR, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::SRE, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::EOR, 3}, {&CPU::ZP0, &CPU::LSR, 5}, {&CPU::ZP0, &CPU::SRE, 5}, {&CPU::IMP, &CPU::PHA, 3}, {&CPU::IMM, &CPU::EOR, 2}, {&CPU::ACC, &CPU::LSR<true>, 2}, {&CPU::IMM, &CPU::ALR, 2}, {&CPU::ABS, &CPU::JMP, 3}, {&CPU::ABS, &CPU::EOR, 4}, {&CPU::ABS, &CPU::LSR, 6}, {&CPU::ABS, &CPU::SRE, 6},
         /* 5X */ {&CPU::REL, &CPU::BVC, 2}, {&CPU::IDY, &CPU::EOR, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::SRE, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::EOR, 4}, {&CPU::ZPX, &CPU::LSR, 6}, {&CPU::ZPX, &CPU::SRE, 6}, {&CPU::IMP, &CPU::CLI, 2}, {&CPU::ABY, &CPU::EOR, 4}, {&CPU::ACC, &CPU::NOP, 2}, {&CPU::ABY, &CPU::SRE, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::EOR, 4}, {&CPU::ABX, &CPU::LSR, 7}, {&CPU::ABX, &CPU::SRE, 7},
-        /* 6X */ {&CPU::IMP, &CPU::RTS, 6}, {&CPU::IDX, &CPU::ADC, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::RRA, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::ADC, 3}, {&CPU::ZP0, &CPU::ROR, 5}, {&CPU::ZP0, &CPU::RRA, 5}, {&CPU::IMP, &CPU::PLA, 4}, {&CPU::IMM, &CPU::ADC, 2}, {&CPU::ACC, &CPU::ROR, 2}, {&CPU::IMM, &CPU::ARR, 2}, {&CPU::IND, &CPU::JMP, 5}, {&CPU::ABS, &CPU::ADC, 4}, {&CPU::ABS, &CPU::ROR, 6}, {&CPU::ABS, &CPU::RRA, 6},
+        /* 6X */ {&CPU::IMP, &CPU::RTS, 6}, {&CPU::IDX, &CPU::ADC, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDX, &CPU::RRA, 8}, {&CPU::ZP0, &CPU::NOP, 3}, {&CPU::ZP0, &CPU::ADC, 3}, {&CPU::ZP0, &CPU::ROR, 5}, {&CPU::ZP0, &CPU::RRA, 5}, {&CPU::IMP, &CPU::PLA, 4}, {&CPU::IMM, &CPU::ADC, 2}, {&CPU::ACC, &CPU::ROR<true>, 2}, {&CPU::IMM, &CPU::ARR, 2}, {&CPU::IND, &CPU::JMP, 5}, {&CPU::ABS, &CPU::ADC, 4}, {&CPU::ABS, &CPU::ROR, 6}, {&CPU::ABS, &CPU::RRA, 6},
         /* 7X */ {&CPU::REL, &CPU::BVS, 2}, {&CPU::IDY, &CPU::ADC, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::RRA, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::ADC, 4}, {&CPU::ZPX, &CPU::ROR, 6}, {&CPU::ZPX, &CPU::RRA, 6}, {&CPU::IMP, &CPU::SEI, 2}, {&CPU::ABY, &CPU::ADC, 4}, {&CPU::ACC, &CPU::NOP, 2}, {&CPU::ABY, &CPU::RRA, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::ADC, 4}, {&CPU::ABX, &CPU::ROR, 7}, {&CPU::ABX, &CPU::RRA, 7},
         /* 8X */ {&CPU::IMM, &CPU::NOP, 2}, {&CPU::IDX, &CPU::STA, 6}, {&CPU::IMM, &CPU::NOP, 2}, {&CPU::IDX, &CPU::SAX, 6}, {&CPU::ZP0, &CPU::STY, 3}, {&CPU::ZP0, &CPU::STA, 3}, {&CPU::ZP0, &CPU::STX, 3}, {&CPU::ZP0, &CPU::SAX, 3}, {&CPU::IMP, &CPU::DEY, 2}, {&CPU::IMM, &CPU::NOP, 2}, {&CPU::IMP, &CPU::TXA, 2}, {&CPU::IMM, &CPU::XAA, 2}, {&CPU::ABS, &CPU::STY, 4}, {&CPU::ABS, &CPU::STA, 4}, {&CPU::ABS, &CPU::STX, 4}, {&CPU::ABS, &CPU::SAX, 4},
         /* 9X */ {&CPU::REL, &CPU::BCC, 2}, {&CPU::IDY, &CPU::STA, 6}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::AHX, 6}, {&CPU::ZPX, &CPU::STY, 4}, {&CPU::ZPX, &CPU::STA, 4}, {&CPU::ZPY, &CPU::STX, 4}, {&CPU::ZPY, &CPU::SAX, 4}, {&CPU::IMP, &CPU::TYA, 2}, {&CPU::ABY, &CPU::STA, 5}, {&CPU::IMP, &CPU::TXS, 2}, {&CPU::ABY, &CPU::TAS, 5}, {&CPU::ABX, &CPU::SHY, 5}, {&CPU::ABX, &CPU::STA, 5}, {&CPU::ABY, &CPU::SHX, 5}, {&CPU::ABY, &CPU::AHX, 5},
-        /* AX */ {&CPU::IMM, &CPU::LDY, 2}, {&CPU::IDX, &CPU::LDA, 6}, {&CPU::IMM, &CPU::LDX, 2}, {&CPU::IDX, &CPU::LAX, 6}, {&CPU::ZP0, &CPU::LDY, 3}, {&CPU::ZP0, &CPU::LDA, 3}, {&CPU::ZP0, &CPU::LDX, 3}, {&CPU::ZP0, &CPU::LAX, 3}, {&CPU::IMP, &CPU::TAY, 2}, {&CPU::IMM, &CPU::LDA, 2}, {&CPU::IMP, &CPU::TAX, 2}, {&CPU::IMM, &CPU::LAX, 2}, {&CPU::ABS, &CPU::LDY, 4}, {&CPU::ABS, &CPU::LDA, 4}, {&CPU::ABS, &CPU::LDX, 4}, {&CPU::ABS, &CPU::LAX, 4},
+        /* AX */ {&CPU::IMM, &CPU::LDY, 2}, {&CPU::IDX, &CPU::LDA, 6}, {&CPU::IMM, &CPU::LDX, 2}, {&CPU::IDX, &CPU::LAX, 6}, {&CPU::ZP0, &CPU::LDY, 3}, {&CPU::ZP0, &CPU::LDA, 3}, {&CPU::ZP0, &CPU::LDX, 3}, {&CPU::ZP0, &CPU::LAX, 3}, {&CPU::IMP, &CPU::TAY, 2}, {&CPU::IMM, &CPU::LDA, 2}, {&CPU::IMP, &CPU::TAX, 2}, {&CPU::IMM, &CPU::LAX<true>, 2}, {&CPU::ABS, &CPU::LDY, 4}, {&CPU::ABS, &CPU::LDA, 4}, {&CPU::ABS, &CPU::LDX, 4}, {&CPU::ABS, &CPU::LAX, 4},
         /* BX */ {&CPU::REL, &CPU::BCS, 2}, {&CPU::IDY, &CPU::LDA, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::LAX, 5}, {&CPU::ZPX, &CPU::LDY, 4}, {&CPU::ZPX, &CPU::LDA, 4}, {&CPU::ZPY, &CPU::LDX, 4}, {&CPU::ZPY, &CPU::LAX, 4}, {&CPU::IMP, &CPU::CLV, 2}, {&CPU::ABY, &CPU::LDA, 4}, {&CPU::IMP, &CPU::TSX, 2}, {&CPU::ABY, &CPU::LAS, 4}, {&CPU::ABX, &CPU::LDY, 4}, {&CPU::ABX, &CPU::LDA, 4}, {&CPU::ABY, &CPU::LDX, 4}, {&CPU::ABY, &CPU::LAX, 4},
         /* CX */ {&CPU::IMM, &CPU::CPY, 2}, {&CPU::IDX, &CPU::CMP, 6}, {&CPU::IMM, &CPU::NOP, 2}, {&CPU::IDX, &CPU::DCP, 8}, {&CPU::ZP0, &CPU::CPY, 3}, {&CPU::ZP0, &CPU::CMP, 3}, {&CPU::ZP0, &CPU::DEC, 5}, {&CPU::ZP0, &CPU::DCP, 5}, {&CPU::IMP, &CPU::INY, 2}, {&CPU::IMM, &CPU::CMP, 2}, {&CPU::IMP, &CPU::DEX, 2}, {&CPU::IMM, &CPU::AXS, 2}, {&CPU::ABS, &CPU::CPY, 4}, {&CPU::ABS, &CPU::CMP, 4}, {&CPU::ABS, &CPU::DEC, 6}, {&CPU::ABS, &CPU::DCP, 6},
         /* DX */ {&CPU::REL, &CPU::BNE, 2}, {&CPU::IDY, &CPU::CMP, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::DCP, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::CMP, 4}, {&CPU::ZPX, &CPU::DEC, 6}, {&CPU::ZPX, &CPU::DCP, 6}, {&CPU::IMP, &CPU::CLD, 2}, {&CPU::ABY, &CPU::CMP, 4}, {&CPU::IMP, &CPU::NOP, 2}, {&CPU::ABY, &CPU::DCP, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::CMP, 4}, {&CPU::ABX, &CPU::DEC, 7}, {&CPU::ABX, &CPU::DCP, 7},
         /* EX */ {&CPU::IMM, &CPU::CPX, 2}, {&CPU::IDX, &CPU::SBC, 6}, {&CPU::IMM, &CPU::NOP, 2}, {&CPU::IDX, &CPU::ISC, 8}, {&CPU::ZP0, &CPU::CPX, 3}, {&CPU::ZP0, &CPU::SBC, 3}, {&CPU::ZP0, &CPU::INC, 5}, {&CPU::ZP0, &CPU::ISC, 5}, {&CPU::IMP, &CPU::INX, 2}, {&CPU::IMM, &CPU::SBC, 2}, {&CPU::IMP, &CPU::NOP, 2}, {&CPU::IMM, &CPU::SBC, 2}, {&CPU::ABS, &CPU::CPX, 4}, {&CPU::ABS, &CPU::SBC, 4}, {&CPU::ABS, &CPU::INC, 6}, {&CPU::ABS, &CPU::ISC, 6},
         /* FX */ {&CPU::REL, &CPU::BEQ, 2}, {&CPU::IDY, &CPU::SBC, 5}, {&CPU::IMP, &CPU::KIL, 0}, {&CPU::IDY, &CPU::ISC, 8}, {&CPU::ZPX, &CPU::NOP, 4}, {&CPU::ZPX, &CPU::SBC, 4}, {&CPU::ZPX, &CPU::INC, 6}, {&CPU::ZPX, &CPU::ISC, 6}, {&CPU::IMP, &CPU::SED, 2}, {&CPU::ABY, &CPU::SBC, 4}, {&CPU::IMP, &CPU::NOP, 2}, {&CPU::ABY, &CPU::ISC, 7}, {&CPU::ABX, &CPU::NOP, 4}, {&CPU::ABX, &CPU::SBC, 4}, {&CPU::ABX, &CPU::INC, 7}, {&CPU::ABX, &CPU::ISC, 7}
         }};
+
+        /**
+         * DISPATCH
+         * 
+         * Instead of calling the addressing mode and operation of an opcode through the lookup table
+         * one handler is generated per opcode at compile time. The handlers are selected by a single
+         * switch so that the addressing mode and operation can be inlined into each handler.
+         */
+
+        template <uint8_t OPCODE> void execute();
+        void dispatch(uint8_t opcode);
+
+        /**
+         * PRE-DECODE CACHE
+         * 
+         * Every instruction run from host memory (PRG-ROM or RAM) is decoded once into its opcode,
+         * operand bytes and cycles, so that running it again neither reads the opcode and operands 
+         * through the bus nor looks up the opcode. The target of a branch is static so whether a taken
+         * branch crosses a page is decoded as well. Instructions in memory mapped I/O are decoded every 
+         * time. Entries are kept small since the cache is read for every instruction.
+         * 
+         * Decoded pages are invalidated by the bus when a mapper maps another bank into the page, or 
+         * when RAM holding decoded code is written.
+         * 
+         * Hits and misses are always counted, at the cost of one increment per instruction, and read
+         * with decodeStats. Instructions of translated blocks are not looked up and not counted.
+         */
+
+        struct Decoded {
+            uint8_t opcode = 0x00; // Selects the handler.
+            uint8_t cycles = 0;
+            uint8_t length = 0; // Bytes of the opcode and operands, zero if not decoded.
+            bool crosses = false; // Does a taken branch cross a page.
+            uint16_t operand = 0x0000; // Operand bytes with the first byte in the low byte.
+        };
+
+        typedef std::array<Decoded, 0x100> DecodedPage;
+
+        std::array<std::unique_ptr<DecodedPage>, 0x100> decoded;
+        Decoded uncached; // Instruction decoded from memory mapped I/O.
+        Decoded const *current = &uncached; // Instruction being run.
+        uint16_t operand = 0x0000; // Operand bytes not yet fetched by the instruction.
+        DecodeStats stats; // Hits and misses of decode.
+
+        Decoded const &decode();
+        Decoded const &decodeMiss();
+        void decode(Decoded &instruction, uint16_t addr);
+
+        /**
+         * BLOCK TRANSLATION
+         * 
+         * Code which is run often from host memory (PRG-ROM or RAM) is translated into blocks. A block
+         * is a run of instructions ending at the first branch, jump, return, interrupt or page boundary.
+         * It is stored as its decoded instructions together with the cycles of the entire block, so
+         * that running it skips looking up each instruction. Interrupts are only checked between 
+         * blocks and a block is only entered if all of its cycles fit in the remaining budget.
+         * 
+         * Blocks are keyed by PC and the host memory they were translated from. If a mapper maps 
+         * another bank into the page the host memory no longer matches and the block is translated
+         * again. Writes to RAM holding translated code invalidate the page through the bus.
+         * 
+         * Blocks are threaded code, lists of the per-opcode handlers. No native code is emitted and 
+         * there is no perf map, so translation stays portable and host profilers see the handlers.
+         */
+
+        struct Block {
+            uint8_t const *source = nullptr; // Host memory the block was translated from.
+            std::vector<Decoded> instructions;
+            uint16_t cycles = 0; // Cycles of the block without oops or branch cycles.
+            uint16_t maxCycles = 0; // Cycles of the block if all oops and branch cycles are taken.
+            uint8_t heat = 0x00; // Times the block has been entered before being translated.
+        };
+
+        typedef std::array<Block, 0x100> BlockPage;
+
+        std::array<std::unique_ptr<BlockPage>, 0x100> blocks;
+        bool invalidated = false; // Was the running block invalidated.
+
+        Block *lookup();
+        void translate(Block &block, uint8_t const *source);
+        uint16_t runBlock(Block &block);
+
+        /**
+         * IDLE LOOPS
+         * 
+         * Games often spin in a short loop while waiting for the NMI, like LDA $2002 / BPL or JMP to 
+         * itself. A loop is tracked from a backward jump or branch to the jump. It can only be idle if
+         * it has no side effects and only reads host memory or PPUSTATUS. If the CPU is unchanged
+         * after an iteration every following iteration repeats it, until something read by the loop 
+         * or an interrupt changes the outcome. The bus then skips iterations up to the next point
+         * where the PPU might change PPUSTATUS or trigger the NMI.
+         */
+
+        struct Loop {
+            uint16_t head = 0x0000; // Target of the backward jump.
+            uint16_t end = 0x0000; // Address of the backward jump.
+            uint16_t elapsed = 0; // Cycles since the CPU was at the head.
+            uint16_t cycles = 0; // Cycles of the last iteration.
+            bool idle = false; // Has the loop no side effects.
+            bool status = false; // Does the loop read PPUSTATUS.
+            bool arrived = false; // Did the last instruction jump to the head.
+            bool confirmed = false; // Did the last iteration leave the CPU unchanged.
+            std::array<uint8_t, 5> state = {}; // A, X, Y, S and P at the head.
+        } loop;
+
+        void track(uint16_t start, bool interrupted, uint16_t cycles);
+        bool polling(uint16_t head, uint16_t end, bool &status);
+
+        /**
+         * PROFILE
+         * 
+         * Only counted when built with NES_PROFILE. Each opcode records how often it was run, the host
+         * time spent in its handler and how often it took an oops cycle. The addressing mode and the 
+         * operation are fused into one handler, so the time cannot be split between them. byModeTotal
+         * and byOpTotal in the dump are the whole-instruction times of the opcodes summed by addressing
+         * mode and by operation, not the time spent in the addressing mode or the operation.
+         */
+
+        #ifdef NES_PROFILE
+        struct Profile {
+            std::array<profiler::Counter, 256> opcodes;
+            std::array<uint64_t, 256> oops = {};
+        } profile;
+        #endif
 };
 
+inline CPU::Decoded const &CPU::decode() {
+    // The lookup is inlined since it is done for every instruction.
+    DecodedPage *page = decoded[pc >> 8].get();
+
+    if (page) {
+        Decoded const &instruction = (*page)[pc & 0x00FF];
+
+        if (instruction.length) {
+            stats.hits++;
+            return instruction;
+        }
+    }
+
+    return decodeMiss();
+}
+
+inline uint8_t CPU::fetch() {
+    // The operand bytes were read when the instruction was decoded.
+    uint8_t data = operand & 0x00FF;
+    operand >>= 8;
+    pc++;
+    return data;
+}
+
 #endif // H_CPU
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef H_COMPOSITE
+#define H_COMPOSITE
+
+#include <cstdint>
+#include <cstddef>
+
+using std::uint8_t;
+
+/**
+ * COMPOSITING
+ *
+ * Merges the background and sprite pixels of a line into palette RAM entries. A background pixel
+ * is its palette index, 0x00-0x0F, and zero if transparent. A sprite pixel is its palette index,
+ * 0x10-0x1F, with bit 5 set if the sprite is behind the background and bit 6 set if it belongs to
+ * the first sprite of the line. A transparent sprite pixel is zero.
+ *
+ * Opaque sprite pixels are drawn in front of the background unless the sprite is behind it. If
+ * both are transparent the backdrop, entry 0x00, is drawn. The entry read from palette RAM is
+ * AND:ed with the mask, which is 0x30 in grayscale. The kernels return if an opaque pixel of the
+ * first sprite was drawn on an opaque background pixel.
+ *
+ * The scalar kernel is the reference. SSE2 is used on all x86 processors and AVX2 if the
+ * processor supports it.
+ */
+
+namespace composite {
+    typedef bool (*Kernel)(
+        uint8_t const *background,
+        uint8_t const *foreground,
+        uint8_t *output,
+        uint8_t const *paletteRam,
+        uint8_t mask,
+        std::size_t size
+    );
+
+    bool scalar(uint8_t const *background, uint8_t const *foreground, uint8_t *output, uint8_t const *paletteRam, uint8_t mask, std::size_t size);
+    bool sse2(uint8_t const *background, uint8_t const *foreground, uint8_t *output, uint8_t const *paletteRam, uint8_t mask, std::size_t size);
+    bool avx2(uint8_t const *background, uint8_t const *foreground, uint8_t *output, uint8_t const *paletteRam, uint8_t mask, std::size_t size);
+
+    Kernel best(); // The fastest kernel supported by the processor.
+    uint8_t pixel(uint8_t background, uint8_t foreground, bool &hit); // Palette RAM entry of one pixel.
+}
+
+inline uint8_t composite::pixel(uint8_t background, uint8_t foreground, bool &hit) {
+    bool backgroundOpaque = (background & 0x03) != 0x00;
+    bool foregroundOpaque = (foreground & 0x03) != 0x00;
+
+    // Sprite 0 hit.
+    if (backgroundOpaque && foregroundOpaque && (foreground & 0x40)) hit = true;
+
+    // The background is drawn if the sprite is transparent or behind it.
+    if (foregroundOpaque && (!backgroundOpaque || !(foreground & 0x20))) return foreground & 0x1F;
+
+    return background;
+}
+
+#endif // H_COMPOSITE
@@ -0,0 +1,29 @@
+#ifndef H_INDEXEDSCREEN
+#define H_INDEXEDSCREEN
+
+#include <cstdint>
+
+#include "Screen.h"
+#include "Palette.h"
+
+using std::uint16_t;
+
+/**
+ * INDEXED SCREEN
+ * 
+ * Stores the output of the PPU instead of the converted colors. Every pixel is the 6 bit color
+ * with the emphasis bits (BGR) in bits 6-8, the same index as used by Palette::lookup. Converting
+ * the colors is left to whatever uses the frame, so frames which are never looked at are never
+ * converted and each pixel takes 2 bytes instead of the 4 bytes of Screen.
+ */
+
+template <std::size_t W, std::size_t H>
+class IndexedScreen : public Screen<W, H, uint16_t> {
+    public:
+        template <PixelFormat F>
+        void convert(Palette<F> &palette, typename Palette<F>::Pixel *pixels); // Convert the acquired frame.
+};
+
+#include "../source/IndexedScreen.tpp"
+
+#endif // H_INDEXEDSCREEN
@@ -9,6 +9,8 @@
 using std::uint16_t;
 using std::uint8_t;
 
+class Bus;
+
 class Mapper {
     public:
         Mapper(
@@ -29,14 +31,46 @@ class Mapper {
         virtual uint8_t ppuRead(uint16_t addr) { return 0x00; };
         virtual void ppuWrite(uint16_t addr, uint8_t data) {};
         virtual uint16_t mirrorAddr(uint16_t addr);
+        virtual uint8_t *nametable(uint16_t addr, uint8_t *vram); // Memory of the nametable at addr.
+
+        /**
+         * PAGE MAPPING
+         * 
+         * Mappers can expose the PRG-ROM mapped to a CPU page directly so that the bus can read it
+         * without going through cpuRead. When the mapper switches banks it has to tell the bus to
+         * remap its pages.
+         * 
+         * In the same way the CHR memory mapped to each 1 KiB bank of the pattern tables can be 
+         * exposed so that the PPU can cache its decoded tiles. Mappers which have to see every
+         * pattern table read, like those counting scanlines, should not expose their CHR memory.
+         * 
+         * Mappers with CHR-RAM have to report it with chrWritable, since the frames can then not be 
+         * rendered on another thread while the CPU writes the patterns, see Pipeline.h.
+         */
+
+        virtual uint8_t *prgPage(uint16_t addr) { return nullptr; };
+        virtual uint8_t *chrBank(uint16_t addr) { return nullptr; };
+        virtual bool chrWritable() { return !chrram.empty(); }; // If the PPU can write CHR memory.
+        Bus *bus = nullptr;
     protected:
+        void remapPrg();
+        void remapChr();
+        void remapNametables();
+        void setMirrorMode(NametableLayout mirrorMode); // Switch layout and remap the nametables.
+
         /**
          * NAMETABLE MIRRORING
          * 
          * To allow scrolling there are two ways of mirroring the nametables supported by the PPU hardware, 
          * horizontal or vertical mirroring. Which one of these are used is determined by the mapper and 
          * allows for vertical or horizontal scrolling respectively. Some mappers might even have extra VRAM
-         * allowing for 4-screen mirroring using the extra VRAM as two more nametables.
+         * allowing for 4-screen mirroring using the extra VRAM as two more nametables. Others can switch
+         * all nametables to a single screen. Without a mapper specific layout the alternative layout is
+         * 4-screen mirroring.
+         * 
+         * The PPU looks up the memory of each of its four nametables once, using nametable, and reads 
+         * them directly after that. Mappers switching layout have to tell the PPU to look them up 
+         * again, which setMirrorMode does. Mappers with their own VRAM can return it from nametable.
          * 
          * Reference: https://www.nesdev.org/wiki/Mirroring
          */
@@ -4,10 +4,15 @@
 #include <cstdint>
 #include <memory>
 #include <array>
+#include <ostream>
+#include <unordered_map>
 
 #include "Mapper.h"
 #include "Palette.h"
 #include "Screen.h"
+#include "IndexedScreen.h"
+#include "Profiler.h"
+#include "Composite.h"
 
 using std::uint16_t;
 using std::uint8_t;
@@ -15,19 +20,44 @@ using std::uint8_t;
 class PPU {
     public:
         void tick();
+        void run(uint32_t dots); // Tick the given number of dots.
         void power();
         void reset();
         void insertCart(std::shared_ptr<Mapper> cart);
+        void mapChr(); // Look up the decoded tiles of the CHR banks mapped by the cartridge.
+        void mapChrBank(uint8_t bank, uint8_t const *source); // Map CHR memory, or nullptr, to a 1 KiB bank.
+        void mapNametables(); // Look up the memory of the nametables mapped by the cartridge.
+        void mapNametable(uint8_t table, uint8_t *memory); // Map memory, or nullptr, to a nametable.
+        uint8_t *lookupNametable(uint8_t table); // Memory the cartridge maps to the nametable.
+        void follow(PPU const &ppu); // Take over the state of another PPU.
+        void snapshot(PPU const &ppu); // Take over the state of another PPU, sharing its decoded tiles.
+        void commit(uint16_t first, uint16_t last); // Commit drawn lines and, with the last line, the frame.
         void connectScreen(std::shared_ptr<Screen<256, 240>> screen);
-        void setPalette(Palette palette);
+        void connectScreen(std::shared_ptr<IndexedScreen<256, 240>> screen);
+        void setPalette(Palette<> palette); // Palette of the Screen, which is always RGBA8888.
         uint8_t registerRead(uint16_t addr);
         void registerWrite(uint16_t addr, uint8_t data);
         void dmaWrite(uint8_t data);
+        uint8_t status() const; // PPUSTATUS without the side effects of reading it.
+        uint32_t idleDots(bool status); // Dots until the NMI or, if status is set, PPUSTATUS might change.
+        uint32_t dotsUntil(uint16_t toScanline, uint16_t toDot); // Dots until the PPU is at the dot.
+
+        #ifdef NES_PROFILE
+        void dumpProfile(std::ostream &out); // Write the profile as a JSON object.
+        #endif
 
         bool nmi = false;
+        bool lineRendering = true; // Render whole scanlines when running past their end.
+        bool spriteIndex = true; // Select the sprites of a line from the sprite index, see below.
+        bool deferCommits = false; // Leave committing lines and frames to commit.
+        uint32_t frameSkip = 1; // Output every frameSkip:th frame, see below.
+        bool frameReuse = true; // Repeat the last frame when nothing it depends on changed, see below.
+        void setOutput(bool output); // Output frames to the screens or only keep the timing.
+        bool reused() const; // If the current frame repeats the last output frame.
     private:
         std::shared_ptr<Screen<256, 240>> screen;
-        Palette palette;
+        std::shared_ptr<IndexedScreen<256, 240>> indexedScreen;
+        Palette<> palette;
 
         bool fblank(); // Forced blank.
 
@@ -148,6 +178,9 @@ class PPU {
          * 0x3F00-0x3F1F: Palette RAM
          * 0x3F20-0x3FFF: Mirrors of 0x3F00-0x3F1F
          * 
+         * The memory of each nametable is looked up from the cartridge when it is inserted or 
+         * switches layout, so that nametables are read directly.
+         * 
          * Reference: https://www.nesdev.org/wiki/PPU_memory_map
          */
 
@@ -155,9 +188,11 @@ class PPU {
         // NOTE: Only 2kB on actual hardware but 4kb here to allow 4-screen mirroring.
         std::array<uint8_t, 0x1000> vram;
         std::array<uint8_t, 0x20> paletteRam;
+        std::array<uint8_t *, 4> nametables = {}; // Memory of each nametable or nullptr.
 
         uint8_t read(uint16_t addr);
         void write(uint16_t addr, uint8_t data);
+        uint8_t readNametable(uint16_t addr); // Read a nametable without checking the address.
 
         /**
          * OBJECT ATTRIBUTE MEMORY (OAM)
@@ -192,6 +227,30 @@ class PPU {
         std::array<OAM, 64> primaryOam;
         std::array<OAM, 8> secondaryOam;
 
+        void writeOam(uint8_t data); // Write to primary OAM at OAMADDR and increment it.
+
+        /**
+         * SPRITE INDEX
+         * 
+         * Instead of evaluating primary OAM one byte per dot, the sprites of a line can be selected
+         * from an index of which sprites cover each line. The index is kept up to date as the y 
+         * coordinates in OAM are written and rebuilt when the sprite height changes. Secondary OAM 
+         * is filled with the first 8 sprites of the line at once and, when there are more, the 
+         * overflow flag is set at the dot where evaluation would have found it, including the 
+         * hardware bug of checking the wrong bytes.
+         * 
+         * Evaluating byte by byte is kept for games depending on how OAM is accessed during 
+         * evaluation.
+         */
+
+        std::array<uint64_t, 240> spriteLines = {}; // Sprites covering each line, sprite n in bit n.
+        bool spriteLinesValid = false;
+        uint16_t overflowDot = 0x0000; // Dot where the overflow flag is set or 0 if it is not.
+
+        void indexSprite(uint8_t sprite, bool covers); // Set if the sprite covers its lines.
+        void buildSpriteIndex();
+        void selectSprites();
+
         /**
          * MOTION PICTURE BUFFER MEMORY (MPBM)
          * 
@@ -199,9 +258,14 @@ class PPU {
          * low and high bits of the sprites pixel on the scanline, palette and priority attribute data and 
          * the x position of the sprite.
          * 
-         * The x position is decremented each dot until it reaches zero, when rendering of the sprite can
-         * start. After the x position reaches zero the low and high bits of the sprite line are shifted 
-         * each dot. 
+         * On hardware the x position is decremented each dot until it reaches zero, when rendering of 
+         * the sprite can start, and the low and high bits are then shifted each dot. Here the sprites 
+         * are instead rasterized into a line buffer once all of them have been fetched. Each entry of
+         * the buffer is the sprite pixel of one column, see Composite.h, with the first opaque sprite 
+         * in the MPBM drawn in front. Drawing a dot then only loads the pixel of its column.
+         * 
+         * NOTE: The x counters only count while rendering, so sprites are not delayed by rendering 
+         * being disabled during a line.
          * 
          * Reference: https://github.com/emu-russia/breaks/blob/master/BreakingNESWiki_DeepL/PPU/fifo.md
          * NesDev reference: https://forums.nesdev.org/viewtopic.php?t=26291
@@ -217,6 +281,39 @@ class PPU {
         };
 
         std::array<MPBM, 8> mpbm;
+        std::array<uint8_t, 256> spriteLine = {}; // Sprite pixel of each column of the line.
+
+        void rasterizeSprites(); // Draw the sprites in the MPBM into the sprite line buffer.
+
+        /**
+         * TILE CACHE
+         * 
+         * The rows of the tiles in each 1 KiB CHR bank exposed by the mapper are decoded once. A row
+         * holds its two pattern bytes and the palette index of each of its 8 pixels, both as stored
+         * and flipped horizontally, so that neither the pattern bytes have to be read through the 
+         * mapper nor sprite rows have to be flipped bit by bit. 
+         * 
+         * Decoded banks are kept by the CHR memory they were decoded from, so switching back to a 
+         * bank does not decode it again. Writes to CHR-RAM decode the written row again.
+         */
+
+        struct TileRow {
+            uint8_t low = 0x00; // Low bits of the pixels with the leftmost pixel in bit 7.
+            uint8_t high = 0x00; // High bits of the pixels with the leftmost pixel in bit 7.
+            uint8_t flippedLow = 0x00;
+            uint8_t flippedHigh = 0x00;
+            std::array<uint8_t, 8> pixels = {}; // Palette index of each pixel from left to right.
+            std::array<uint8_t, 8> flippedPixels = {};
+        };
+
+        typedef std::array<TileRow, 0x200> TileBank; // 64 tiles of 8 rows.
+
+        std::unordered_map<uint8_t const *, std::shared_ptr<TileBank>> tileBanks;
+        std::array<uint8_t const *, 8> chrBanks = {}; // CHR memory mapped to each bank or nullptr.
+        std::array<TileBank *, 8> tiles = {}; // Decoded tiles of each bank or nullptr.
+
+        void decodeRow(TileRow &row, uint8_t const *pattern);
+        uint8_t fetchPattern(uint16_t addr, bool flip = false);
 
         /**
          * RENDERING
@@ -250,11 +347,106 @@ class PPU {
         void tickVisibleFrame();
         void tickPreRender();
         void drawDot();
+        void putDot(uint16_t x, uint8_t color); // Put a palette RAM color to the connected screen.
+        uint8_t backgroundPixel(); // Background pixel of the dot, see Composite.h.
+        uint8_t foregroundPixel(); // Sprite pixel of the dot, see Composite.h.
+        void displayFrame();
         void fetchBackground();
+        void fetchTile();
         void fetchForeground();
+        void evaluateSprites(); // Clear secondary OAM or evaluate sprites on an even dot 2-256.
+        void evaluateSprite();
         uint16_t spriteAddr(OAM tile);
         void updateShifters();
+        void shiftBackground();
         void loadShifters();
+
+        /**
+         * LINE RENDERING
+         * 
+         * When the PPU runs past the end of a visible scanline nothing can change the registers, OAM
+         * or memory of the PPU during the line, since the CPU accessing the PPU or the cartridge 
+         * makes the PPU catch up first. The line is then rendered in one pass with the checks of 
+         * which dot is being drawn done once per range of dots instead of once per dot. Lines the 
+         * CPU interrupts, like mid-line scroll changes, are rendered dot by dot.
+         * 
+         * The dots of vblank are skipped since nothing happens during them, except the start of 
+         * vblank.
+         * 
+         * The background and sprite pixels of the line are recorded while the line is fetched and
+         * then composited into palette RAM entries all at once.
+         */
+
+        std::array<uint8_t, 256> lineBackground = {};
+        std::array<uint8_t, 256> lineForeground = {};
+        std::array<uint8_t, 256> lineOutput = {};
+        composite::Kernel compositeLine = composite::best();
+
+        void renderLine();
+
+        /**
+         * FRAME SKIPPING
+         * 
+         * Only every frameSkip:th frame is output to the connected screens. The other frames are run
+         * for their timing only: vblank, NMI, sprite overflow and sprite 0 hits happen as usual, but 
+         * no colors are looked up and nothing is written to the screens. Pixels are only composited
+         * on lines where sprite 0 might be hit. Without output no frames are output at all.
+         */
+
+        bool output = true;
+        bool outputFrame = true; // If the current frame is selected to be output.
+        uint32_t skippedFrames = 1; // Frames since the last selected frame, including it.
+        bool spritesSkipped = false; // If the sprites of the current line were not rasterized.
+
+        bool drawn(); // If the current frame is output.
+
+        /**
+         * FRAME REUSE
+         * 
+         * Static screens, like menus and pauses, output the same frame over and over. Writes changing
+         * VRAM, palette RAM, OAM or CHR-RAM, mapping other CHR banks or nametables and changing the 
+         * palette or the screens mark the frame as changed. An output frame without changes since 
+         * the last one started, and starting with the same PPUCTRL, PPUMASK, v, t and fine x, is not
+         * drawn. The screens repeat their newest frame instead. Sprite 0 hits and the rest of the
+         * timing are found as in skipped frames.
+         * 
+         * The registers only have to be the same when the frame starts, like after the updates 
+         * games make during vblank, unless they change on the pre-render or a visible line. If 
+         * something changes while a frame is repeated, the lines before are copied from the newest
+         * frame and the rest of the frame is drawn.
+         * 
+         * Frames run without output count as output, since such a PPU is followed by another which 
+         * outputs its frames, see Pipeline.h.
+         * 
+         * NOTE: Changes the mapper makes without the PPU, like writing its own nametable RAM, are not
+         * seen.
+         */
+
+        bool frameChanged = true; // If anything changed since the start of the last output frame.
+        bool reusing = false; // If the current frame repeats the last output frame.
+        uint64_t frameRegisters = 0x0000000000000000; // Registers at the start of the last output frame.
+
+        void invalidate(); // Something the pixels depend on changed.
+        bool inFrame(); // If the PPU is on the pre-render line or a visible line.
+        uint64_t registers(); // PPUCTRL, PPUMASK, fine x, t and v packed together.
+        void repeatFrame(); // The repeated frame is done.
+
+        /**
+         * PROFILE
+         * 
+         * Only counted when built with NES_PROFILE. The host time of a dot is split between the
+         * parts of the visible frame, each timed including the parts it calls.
+         */
+
+        #ifdef NES_PROFILE
+        struct Profile {
+            profiler::Counter tick;
+            profiler::Counter tickVisibleFrame;
+            profiler::Counter fetchForeground;
+            profiler::Counter drawDot;
+            profiler::Counter renderLine;
+        } profile;
+        #endif
 };
 
 #endif // H_PPU
\ No newline at end of file
@@ -2,25 +2,109 @@
 #define H_PALETTE
 
 #include <cstdint>
+#include <cstddef>
+#include <array>
 #include <vector>
+#include <type_traits>
 
+#include "constants.h"
+
+using std::uint32_t;
 using std::uint16_t;
 using std::uint8_t;
 
+/**
+ * PALETTE
+ *
+ * Converts the 6 bit colors of the PPU to pixels of the format F. Every color is packed for all 8
+ * combinations of the emphasis bits when the palette is created, so a color is looked up with a
+ * single read of a 512 entry table. The emphasis only selects which 64 entries are used.
+ *
+ * The palette data holds 3 bytes, red, green and blue, per color. 192 bytes cover the 64 colors
+ * and 1536 bytes the colors of every emphasis, ordered by the emphasis bits (BGR). Smaller data is
+ * repeated. Without data the built-in palette is used.
+ *
+ * The PPU only draws to a Screen with the default format, RGBA8888 in uint32_t, so setPalette of
+ * the PPU and the bus only take Palette<>. A consumer which needs BGRA8888, XRGB8888 or RGB565
+ * connects an IndexedScreen instead and converts the frames with a palette of that format.
+ *
+ * Reference: https://www.nesdev.org/wiki/PPU_palettes
+ */
+
+template <PixelFormat F = PixelFormat::RGBA8888>
 class Palette {
     public:
-        // TODO: Document
-        Palette() = default;
-        Palette(std::vector<uint8_t> data) : data{data} {};
+        typedef std::conditional_t<F == PixelFormat::RGB565, uint16_t, uint32_t> Pixel;
 
+        Palette();
+        Palette(std::vector<uint8_t> data);
+
+        Pixel get(uint16_t entry); // Packed pixel of the color with the current emphasis.
+        Pixel lookup(uint16_t index); // Packed pixel of the color with the emphasis in bits 6-8.
         uint8_t getR(uint16_t entry);
         uint8_t getG(uint16_t entry);
         uint8_t getB(uint16_t entry);
         void setEmphasis(uint16_t emphasis);
         void setEmphasis(bool r, bool g, bool b);
+
+        static constexpr Pixel pack(uint8_t r, uint8_t g, uint8_t b);
+        static constexpr std::array<uint8_t, 3> unpack(Pixel pixel);
     private:
         uint16_t emphasis = 0x00;
-        std::vector<uint8_t> data;
+        std::array<Pixel, 512> table;
+
+        void build(uint8_t const *data, std::size_t size);
 };
 
-#endif // H_PALETTE
\ No newline at end of file
+/**
+ * BUILT-IN PALETTE
+ *
+ * The 2C02 colors as commonly used by emulators. Emphasis darkens the channels of the colors
+ * which are not emphasized, once for every emphasis bit set.
+ */
+
+namespace palette {
+    constexpr std::array<uint8_t, 192> COLORS = {
+        0x74, 0x74, 0x74, 0x24, 0x18, 0x8C, 0x00, 0x00, 0xA8, 0x44, 0x00, 0x9C,
+        0x8C, 0x00, 0x74, 0xA8, 0x00, 0x10, 0xA4, 0x00, 0x00, 0x7C, 0x08, 0x00,
+        0x40, 0x2C, 0x00, 0x00, 0x44, 0x00, 0x00, 0x50, 0x00, 0x00, 0x3C, 0x14,
+        0x18, 0x3C, 0x5C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xBC, 0xBC, 0xBC, 0x00, 0x70, 0xEC, 0x20, 0x38, 0xEC, 0x80, 0x00, 0xF0,
+        0xBC, 0x00, 0xBC, 0xE4, 0x00, 0x58, 0xD8, 0x28, 0x00, 0xC8, 0x4C, 0x0C,
+        0x88, 0x70, 0x00, 0x00, 0x94, 0x00, 0x00, 0xA8, 0x00, 0x00, 0x90, 0x38,
+        0x00, 0x80, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFC, 0xFC, 0xFC, 0x3C, 0xBC, 0xFC, 0x5C, 0x94, 0xFC, 0xCC, 0x88, 0xFC,
+        0xF4, 0x78, 0xFC, 0xFC, 0x74, 0xB4, 0xFC, 0x74, 0x60, 0xFC, 0x98, 0x38,
+        0xF0, 0xBC, 0x3C, 0x80, 0xD0, 0x10, 0x4C, 0xDC, 0x48, 0x58, 0xF8, 0x98,
+        0x00, 0xE8, 0xD8, 0x78, 0x78, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFC, 0xFC, 0xFC, 0xA8, 0xE4, 0xFC, 0xC4, 0xD4, 0xFC, 0xD4, 0xC8, 0xFC,
+        0xFC, 0xC4, 0xFC, 0xFC, 0xC4, 0xD8, 0xFC, 0xBC, 0xB0, 0xFC, 0xD8, 0xA8,
+        0xFC, 0xE4, 0xA0, 0xE0, 0xFC, 0xA0, 0xA8, 0xF0, 0xBC, 0xB0, 0xFC, 0xCC,
+        0x9C, 0xFC, 0xF0, 0xC4, 0xC4, 0xC4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    constexpr std::array<uint8_t, 1536> emphasize(std::array<uint8_t, 192> colors) {
+        std::array<uint8_t, 1536> data = {};
+
+        for (std::size_t emphasis = 0; emphasis < 8; emphasis++) {
+            for (std::size_t i = 0; i < 192; i++) {
+                uint16_t value = colors[i];
+
+                // Every emphasized channel darkens the other two by about 18 %.
+                for (std::size_t channel = 0; channel < 3; channel++) {
+                    if ((emphasis & (1 << channel)) && channel != i % 3) value = value * 209 / 256;
+                }
+
+                data[emphasis * 192 + i] = value;
+            }
+        }
+
+        return data;
+    }
+
+    constexpr std::array<uint8_t, 1536> DEFAULT = emphasize(COLORS);
+}
+
+#include "../source/Palette.tpp"
+
+#endif // H_PALETTE
@@ -0,0 +1,128 @@
+#ifndef H_PIPELINE
+#define H_PIPELINE
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "PPU.h"
+
+using std::uint64_t;
+using std::uint16_t;
+using std::uint8_t;
+
+/**
+ * PIPELINE
+ *
+ * Renders the frames on a second thread while the CPU runs ahead. The PPU of the bus keeps running
+ * on the CPU thread without output, which gives exact answers to the CPU, like the vblank, sprite
+ * 0 hit and sprite overflow flags of PPUSTATUS, at a fraction of the cost of rendering. Every
+ * access changing the state of the PPU, register writes and reads with side effects, OAM DMA and
+ * CHR bank and nametable switches, is recorded with the master clock it happened at. At the end
+ * of each frame the log is handed over to the renderer, a copy of the PPU which replays it and
+ * outputs the frame. The CPU waits if the renderer falls more than a frame behind.
+ *
+ * At the end of each frame the renderer compares its PPUSTATUS with the one of the bus. If they
+ * diverged the renderer takes over the state of the PPU of the bus again, which is also done when
+ * the bus changes the PPU in other ways, like connecting a screen or resetting.
+ *
+ * With workers, the visible lines of a frame are rendered in bands on worker threads. The renderer
+ * replays the frame without output and takes a snapshot of the PPU at the first line of each band,
+ * from which a worker replays the band with output. Each band is rendered by the same PPU from the
+ * same state, so the frame is identical to one rendered at once, even with mid-frame scrolling. 
+ * Frames accessing PPUDATA or switching CHR banks or nametables during the visible lines are 
+ * rendered at once, since the snapshots share the decoded tiles of the renderer, and so are
+ * frames repeating the last frame, see PPU.h.
+ *
+ * The renderer reads the CHR memory of the cartridge while the CPU runs ahead, so the patterns
+ * must not change under it. Carts with writable CHR memory are rendered serially instead, see
+ * Bus::setPipelining.
+ *
+ * NOTE: Cartridge memory is shared, so mappers must not expect PPU reads or writes to be seen once.
+ */
+
+class Pipeline {
+    public:
+        ~Pipeline();
+
+        enum class Kind : uint8_t {
+            READ = 0x00, // Register read with side effects, PPUSTATUS or PPUDATA.
+            WRITE = 0x01, // Register write.
+            DMA = 0x02, // OAM DMA write.
+            CHR = 0x03, // CHR memory mapped to the bank in addr.
+            NAMETABLE = 0x04 // Memory mapped to the nametable in addr.
+        };
+
+        void start(PPU const &ppu, uint64_t clock); // Let the renderer take over the state of ppu at clock.
+        void stop(uint64_t clock, uint8_t status); // Replay everything recorded until clock and wait for it.
+        void record(uint64_t clock, Kind kind, uint16_t addr, uint8_t data = 0x00, uint8_t *memory = nullptr);
+        void submit(uint64_t clock, uint8_t status); // Hand over the frame ending at clock.
+        bool diverged(); // If PPUSTATUS of the renderer differed from status at the end of a frame.
+        uint8_t *lookupNametable(uint8_t table); // Memory the cartridge maps to the renderer's nametable.
+        void setWorkers(uint8_t workers); // Render frames in bands on this many worker threads.
+    private:
+        struct Access {
+            uint64_t clock = 0x0000000000000000;
+            Kind kind = Kind::WRITE;
+            uint16_t addr = 0x0000;
+            uint8_t data = 0x00;
+            uint8_t *memory = nullptr;
+        };
+
+        struct Frame {
+            std::vector<Access> log;
+            uint64_t end = 0x0000000000000000;
+            uint8_t status = 0x00;
+        };
+
+        // Only used by the CPU thread.
+        std::vector<Access> log;
+        std::thread thread;
+        bool running = false; // If the renderer follows the PPU of the bus.
+
+        // Only used by the renderer thread while it renders.
+        PPU renderer;
+        uint64_t clock = 0x0000000000000000;
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<Frame> frames; // Frames to render, the first one is rendered.
+        bool quit = false;
+        std::atomic<bool> divergence = false;
+
+        void wait(); // Wait until all frames are rendered.
+        void render();
+        void replay(Frame const &frame);
+
+        // Replay the accesses of the log from first until end on the PPU and return the next one.
+        static std::size_t replay(PPU &ppu, std::vector<Access> const &log, std::size_t first, uint64_t &clock, uint64_t end);
+
+        struct Band {
+            PPU ppu;
+            uint64_t start = 0x0000000000000000; // Master clock of the first line of the band.
+            uint64_t end = 0x0000000000000000;
+            std::size_t first = 0; // First access of the band in the log.
+            std::vector<Access> const *log = nullptr;
+        };
+
+        // Only changed while the renderer is idle.
+        std::vector<std::thread> workers;
+        std::vector<Band> bands;
+
+        std::mutex bandMutex;
+        std::condition_variable bandChanged;
+        std::size_t queued = 0; // Bands handed over to the workers.
+        std::size_t taken = 0; // Bands taken by the workers.
+        std::size_t finished = 0; // Bands rendered by the workers.
+        bool quitWorkers = false;
+
+        bool banded(Frame const &frame); // Prepare the bands if the frame can be rendered in bands.
+        void replayBands(Frame const &frame);
+        void work();
+};
+
+#endif // H_PIPELINE
@@ -0,0 +1,53 @@
+#ifndef H_PROFILER
+#define H_PROFILER
+
+/**
+ * PROFILER
+ *
+ * Host instrumentation of the emulator, only built when NES_PROFILE is defined. Without it none of
+ * the counters exist and nothing is measured. The counters record how often a part of the emulator
+ * runs and the host nanoseconds spent in it, and are dumped as JSON.
+ */
+
+#ifdef NES_PROFILE
+
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+
+using std::uint64_t;
+
+namespace profiler {
+    struct Counter {
+        uint64_t count = 0;
+        uint64_t nanoseconds = 0;
+
+        void add(Counter const &counter);
+    };
+
+    // Measures the host time from construction to destruction.
+    class Timer {
+        public:
+            Timer(Counter &counter);
+            ~Timer();
+        private:
+            Counter &counter;
+            std::chrono::steady_clock::time_point start;
+    };
+
+    void writeCounter(std::ostream &out, char const *name, Counter const &counter);
+}
+
+inline profiler::Timer::Timer(Counter &counter) : counter(counter) {
+    start = std::chrono::steady_clock::now();
+}
+
+inline profiler::Timer::~Timer() {
+    std::chrono::nanoseconds passed = std::chrono::steady_clock::now() - start;
+    counter.count++;
+    counter.nanoseconds += passed.count();
+}
+
+#endif // NES_PROFILE
+
+#endif // H_PROFILER
@@ -0,0 +1,32 @@
+#ifndef H_RECORDINGSCREEN
+#define H_RECORDINGSCREEN
+
+#include <cstdint>
+#include <ostream>
+
+#include "Screen.h"
+
+using std::uint32_t;
+
+/**
+ * RECORDING SCREEN
+ * 
+ * Writes every finished frame to a stream as raw pixels, row by row from the top left, in the 
+ * byte order of the host. Nothing is written when the stream has failed. Repeated frames are 
+ * written again from the newest frame, so the stream keeps one frame per frame of the PPU.
+ */
+
+template <std::size_t W, std::size_t H, typename T = uint32_t>
+class RecordingScreen : public Screen<W, H, T> {
+    public:
+        RecordingScreen(std::ostream &out) : out{&out} {};
+
+        void commitFrame() override;
+        void repeatFrame() override;
+    private:
+        std::ostream *out;
+};
+
+#include "../source/RecordingScreen.tpp"
+
+#endif // H_RECORDINGSCREEN
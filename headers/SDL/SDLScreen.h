@@ -9,12 +9,33 @@
 
 using std::uint8_t;
 
+/**
+ * SDL SCREEN
+ * 
+ * Presents the newest frame with an SDL renderer. The frame is uploaded once to a streaming 
+ * texture in the pixel format of the screen, RGBA8888, and drawn as a single quad. The quad is 
+ * centered and scaled to fit the output, either keeping the aspect ratio or by whole multiples 
+ * only. The texture is only uploaded when there is a new frame.
+ * 
+ * Only the SDL renderer API is used, so it also works with the offscreen and dummy video drivers.
+ */
+
 template <std::size_t W, std::size_t H>
 class SDLScreen : public Screen<W, H> {
     public:
+        ~SDLScreen();
+
         void draw(SDL_Renderer *renderer);
+        void setIntegerScaling(bool integerScaling); // Only scale the frame by whole multiples.
+        bool setVSync(SDL_Renderer *renderer, int vsync); // Sync presenting every vsync:th refresh, 0 disables.
+    private:
+        SDL_Renderer *renderer = nullptr; // Renderer the texture was created for.
+        SDL_Texture *texture = nullptr;
+        bool integerScaling = false;
+
+        bool createTexture(SDL_Renderer *renderer);
 };
 
 #include "../../source/SDL/SDLScreen.tpp"
 
-#endif // H_SDLSCREEN
\ No newline at end of file
+#endif // H_SDLSCREEN
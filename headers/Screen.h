@@ -3,28 +3,71 @@
 
 #include <cstdint>
 #include <array>
+#include <atomic>
 
+using std::uint64_t;
+using std::uint32_t;
 using std::uint8_t;
 
-template <std::size_t W, std::size_t H>
+/**
+ * SCREEN
+ * 
+ * Holds three buffers of pixels of type T, by default packed pixels of Palette<>. The producer, 
+ * the PPU, draws to the back buffer while the consumer, which presents, encodes or records the 
+ * frames, reads the front buffer. The third buffer holds the newest finished frame between them.
+ * 
+ * The rows of the back buffer are written directly through line or frame. When a row is done 
+ * commitLine is called and when the frame is done commitFrame, which trades the back buffer for
+ * the buffer in between. The consumer calls acquire to trade its front buffer for the newest
+ * finished frame. Buffers are only ever traded by index, so no pixels are copied and neither side
+ * waits for the other. Each side may only be used by one thread at a time.
+ * 
+ * Frames are numbered from 1 as they are committed. A consumer can tell from the number of the 
+ * front buffer if frames were dropped or if the same frame is acquired again.
+ * 
+ * A frame identical to the newest frame can be repeated with repeatFrame instead, which numbers 
+ * it without drawing it or trading buffers. A consumer which acquires no new frame while latest 
+ * has passed the number of its front buffer knows that the frames since were unchanged, so it 
+ * can skip presenting or encoding them. The producer may copy rows of the newest frame with 
+ * repeatLine, since the buffer of the newest frame is only read until the next commitFrame.
+ */
+
+template <std::size_t W, std::size_t H, typename T = uint32_t>
 class Screen {
     public:
-        virtual void put(std::size_t x, std::size_t y, uint8_t r, uint8_t g, uint8_t b);
-        virtual void put(std::size_t x, std::size_t y, std::array<uint8_t, 3> color);
-        virtual std::array<uint8_t, 3> get(std::size_t x, std::size_t y);
-        virtual void swap();
+        typedef T Pixel;
+
+        virtual ~Screen() = default;
+
+        // Producer side.
+        Pixel *line(std::size_t y); // Writable row y of the back buffer.
+        Pixel *frame(); // Writable back buffer.
+        virtual void commitLine(std::size_t y); // Row y of the back buffer is done.
+        virtual void commitFrame(); // The back buffer is done and becomes the newest frame.
+        virtual void repeatFrame(); // The frame is the same as the newest frame and is not drawn.
+        void repeatLine(std::size_t y); // Copy row y of the newest frame to the back buffer.
+
+        // Consumer side.
+        bool acquire(); // Make the newest frame the front buffer, false if there was no new frame.
+        Pixel const *front(); // The acquired frame.
+        uint64_t sequence(); // Number of the acquired frame or 0 if none has been acquired.
+        uint64_t latest(); // Number of the newest frame, committed or repeated, or 0 if none.
     protected:
-        struct RGBA {
-            uint8_t r = 0x00;
-            uint8_t g = 0x00;
-            uint8_t b = 0x00;
-            uint8_t a = 0xFF;
-        };
-        typedef std::array<RGBA, W * H> Buffer;
-
-        std::array<Buffer, 2> buffers;
+        typedef std::array<Pixel, W * H> Buffer;
+
+        static constexpr uint8_t FRESH = 0x04; // The buffer in between has not been acquired.
+
+        std::array<Buffer, 3> buffers = {};
+        std::array<uint64_t, 3> sequences = {};
+
+        uint8_t back = 0; // Only used by the producer.
+        uint8_t newest = 1; // Buffer of the newest frame, only used by the producer.
+        uint64_t committed = 0; // Only used by the producer.
+        alignas(64) std::atomic<uint64_t> numbered = 0; // Number of the newest frame.
+        alignas(64) std::atomic<uint8_t> middle = 1; // Index of the buffer in between and FRESH.
+        alignas(64) uint8_t current = 2; // Only used by the consumer.
 };
 
 #include "../source/Screen.tpp"
 
-#endif // H_SCREEN
\ No newline at end of file
+#endif // H_SCREEN
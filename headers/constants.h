@@ -12,6 +12,8 @@ using std::uint8_t;
  * 
  * The nametables can be mapped in different ways to allow scrolling. A mapper can
  * hardwire this layout, switch between layouts or support an entirely different layout.
+ * The single screen layouts can't be described by the header and are only selected by 
+ * mappers.
  * 
  * Reference: https://www.nesdev.org/wiki/NES_2.0#Nametable_layout
  */
@@ -20,7 +22,9 @@ enum class NametableLayout : uint8_t {
     HORIZONTAL = 0x00,
     VERTICAL = 0x01,
     ALTERNATIVE = 0x02,
-    FOUR = 0x03
+    FOUR = 0x03,
+    SINGLE_LOWER = 0x04,
+    SINGLE_UPPER = 0x05
 };
 
 /**
@@ -84,4 +88,21 @@ enum class ExpansionDevice : uint8_t {
     UNSUPPORTED = 0xFF
 };
 
+/**
+ * PIXEL FORMAT
+ * 
+ * The layout of a packed pixel, named from the most to the least significant bits of the value as
+ * in SDL. RGBA8888 has red in the highest byte, XRGB8888 leaves the highest byte unused and RGB565
+ * packs the color into 16 bits.
+ * 
+ * Reference: https://wiki.libsdl.org/SDL3/SDL_PixelFormat
+ */
+
+enum class PixelFormat : uint8_t {
+    RGBA8888 = 0x00,
+    BGRA8888 = 0x01,
+    XRGB8888 = 0x02,
+    RGB565 = 0x03
+};
+
 #endif // H_CONSTANTS
\ No newline at end of file
@@ -31,6 +31,8 @@ class NROM : public Mapper {
 
         virtual uint8_t cpuRead(uint16_t addr) override;
         virtual uint8_t ppuRead(uint16_t addr) override;
+        virtual uint8_t *prgPage(uint16_t addr) override;
+        virtual uint8_t *chrBank(uint16_t addr) override;
     private:
         uint16_t prgAddr(uint16_t addr);
         uint16_t chrAddr(uint16_t addr);
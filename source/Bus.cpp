@@ -1,5 +1,7 @@
 #include <cstdint>
 #include <memory>
+#include <ostream>
+#include <algorithm>
 
 #include "Bus.h"
 
@@ -9,6 +11,7 @@ using std::uint8_t;
 
 Bus::Bus() {
     this->cpu.bus = this;
+    mapPages();
 }
 
 void Bus::update(uint64_t time) {
@@ -33,10 +36,8 @@ void Bus::update(uint64_t time) {
     remainingCycles = nanoCycles - cycles * 1000000000 * 4;
     previousTime = time;
 
-    // Tick the bus for the amount of cycles passed since last update.
-    while (cycles--) {
-        tick();
-    }
+    // Run the bus for the amount of cycles passed since last update.
+    run(clock + cycles);
 }
 
 void Bus::pause() {
@@ -67,6 +68,9 @@ void Bus::tick() {
 
     uint8_t offset = 0;
 
+    // The CPU and PPU are ticked in lockstep so the PPU has to catch up first.
+    if (ppuClock < clock) sync();
+
     // No need to increase main cycle over CPU * PPU main clocks / clock.
     cycle = cycle % (ppurate * cpurate);
 
@@ -77,56 +81,395 @@ void Bus::tick() {
         // If DMA is active move data to PPU.
         if (dmaActive) dmaTransfer();
     }
-    if (cycle % ppurate == 0) ppu.tick();
+    if (cycle % ppurate == 0) {
+        tickPPU(1);
+        clock++;
+    }
 
-    // If the PPU has indicated an NMI one should be triggered on the CPU.
-    if (ppu.nmi) cpu.delay(&CPU::nmi);
-    ppu.nmi = false;
+    // Handle the events which are due, like an NMI indicated by the PPU.
+    if (ppuClock >= deadline) handleEvents();
 
     // Tick the main clock once.
     cycle++;
 }
 
+void Bus::run(uint64_t target) {
+    if (!cartInserted) return;
+
+    while (clock < target) {
+        // Tick until the CPU is about to start a new instruction.
+        while (dmaActive || !cpu.done() || cycle % 3 != 0) tick();
+        if (clock >= deadline) sync();
+        if (clock >= target) break;
+
+        // The CPU runs ahead until the next event or the target. It advances the master clock 
+        // after each instruction, so the PPU catches up to the right dot when it is accessed.
+        uint64_t end = std::min(target, deadline);
+        cpu.run((end - clock + 2) / 3);
+
+        // A DMA started by the last instruction suspends the CPU until the page is transferred.
+        if (dmaActive) dma();
+        if (clock >= deadline) sync();
+        if (idleSkip) skipIdle(target);
+
+        // The main clock is aligned with the start of the next CPU cycle.
+        cycle = 0x00;
+    }
+}
+
+uint16_t Bus::stepInstruction() {
+    if (!cartInserted) return 0x0000;
+
+    // Tick until the CPU is about to start a new instruction.
+    while (dmaActive || !cpu.done() || cycle % 3 != 0) tick();
+
+    // Run the entire instruction at once.
+    uint16_t cycles = cpu.stepInstruction();
+
+    clock += cycles * 3;
+
+    // A DMA started by the instruction suspends the CPU until the entire page is transferred.
+    if (dmaActive) cycles += dma();
+
+    // The PPU only catches up when an event is due, like the NMI which has to be triggered before
+    // the next instruction. Otherwise it waits until the CPU accesses it.
+    if (clock >= deadline) sync();
+
+    // Skip iterations of an idle loop while nothing it reads can change.
+    if (idleSkip) cycles += skipIdle(NEVER);
+
+    // The main clock is aligned with the start of the next CPU cycle.
+    cycle = 0x00;
+
+    return cycles;
+}
+
+void Bus::tickPPU(uint32_t dots) {
+    ppuClock += dots;
+    ppu.run(dots);
+}
+
+void Bus::runPPU(uint64_t target) {
+    handleEvents();
+
+    // Tick the PPU from one deadline to the next.
+    while (ppuClock < target) {
+        tickPPU(std::min(target, deadline) - ppuClock);
+        handleEvents();
+    }
+}
+
+void Bus::sync() {
+    runPPU(clock);
+}
+
+void Bus::schedule(Event event, uint64_t dots) {
+    events[static_cast<uint8_t>(event)] = clock + dots;
+    deadline = std::min(deadline, clock + dots);
+}
+
+void Bus::reschedule() {
+    // Events of the next frame are predicted from the position of the PPU. The NMI is indicated 
+    // right after the first dot of vblank.
+    events[static_cast<uint8_t>(Event::NMI)] = ppuClock + ppu.dotsUntil(241, 1) + 1;
+
+    // The frame is drawn after the last dot of the visible frame.
+    events[static_cast<uint8_t>(Event::FRAME)] = ppuClock + ppu.dotsUntil(239, 340) + 1;
+
+    deadline = *std::min_element(events.begin(), events.end());
+}
+
+void Bus::handleEvents() {
+    while (deadline <= ppuClock) {
+        uint8_t next = std::min_element(events.begin(), events.end()) - events.begin();
+        events[next] = NEVER;
+        deadline = *std::min_element(events.begin(), events.end());
+
+        // The event might access the PPU or schedule other events.
+        handle(static_cast<Event>(next));
+    }
+}
+
+void Bus::handle(Event event) {
+    switch (event) {
+        case Event::NMI:
+            // If the PPU has indicated an NMI one should be triggered on the CPU.
+            if (ppu.nmi) cpu.delay(&CPU::nmi);
+            ppu.nmi = false;
+            reschedule();
+            break;
+        case Event::IRQ:
+            cpu.delay(&CPU::irq);
+            break;
+        case Event::FRAME:
+            frameCount++;
+
+            // Hand the frame over to the renderer and start over if it rendered another frame.
+            if (pipelining) pipeline.submit(ppuClock, ppu.status());
+            if (pipelining && pipeline.diverged()) follow();
+
+            reschedule();
+            break;
+    }
+}
+
+uint64_t Bus::frames() {
+    return frameCount;
+}
+
+uint64_t Bus::time() {
+    return clock;
+}
+
+CPU::DecodeStats Bus::decodeStats() {
+    return cpu.decodeStats();
+}
+
+uint16_t Bus::skipIdle(uint64_t target) {
+    CPU::IdleLoop loop = cpu.idleLoop();
+    if (!loop.head) return 0;
+
+    // The loop is only idle until the PPU changes something, so the PPU has to catch up first.
+    sync();
+
+    // No iterations are skipped past the next event, like an IRQ.
+    uint32_t window = std::min<uint64_t>(ppu.idleDots(loop.status), deadline - ppuClock);
+    uint16_t skipped = 0;
+
+    // Nor past the target of run, which would let the emulator run ahead of real time.
+    uint64_t limit = std::min<uint64_t>(window, target > clock ? target - clock : 0);
+
+    // The memory read by the last iteration has to be unchanged during the skipped iterations.
+    if (loop.confirmed && idleWindow >= loop.cycles * 3) {
+        uint32_t iterations = limit / (loop.cycles * 3);
+        skipped = iterations * loop.cycles;
+        window -= skipped * 3;
+
+        clock += skipped * 3;
+        sync();
+
+        // CPU switches being allowing DMA to read or write each cycle.
+        if (skipped & 0x0001) cpu.dmaRead = !cpu.dmaRead;
+    }
+
+    idleWindow = window;
+
+    return skipped;
+}
+
 void Bus::power() {
+    sync();
     cpu.power();
     ppu.power();
     apu.power();
+    follow();
+    reschedule();
 }
 
 void Bus::reset() {
+    sync();
     cpu.reset();
     ppu.reset();
     apu.reset();
+    follow();
+    reschedule();
 }
 
 void Bus::insertCart(std::shared_ptr<Mapper> cart) {
     this->cart = cart;
+    this->cart->bus = this;
+    updatePipelining();
+    mapCart();
     ppu.insertCart(cart);
     cartInserted = true;
     ppu.power();
     cpu.power();
+    follow();
+    reschedule();
 }
 
 void Bus::connectScreen(std::shared_ptr<Screen<256, 240>> screen) {
     ppu.connectScreen(screen);
+    follow();
+}
+
+void Bus::connectScreen(std::shared_ptr<IndexedScreen<256, 240>> screen) {
+    ppu.connectScreen(screen);
+    follow();
 }
 
 void Bus::connectController(std::shared_ptr<BaseController> controller, uint16_t addr) {
     controllers[addr & 0x0001] = controller;
 }
 
-void Bus::setPalette(Palette palette) {
+void Bus::setPalette(Palette<> palette) {
     ppu.setPalette(palette);
+    follow();
+}
+
+void Bus::setTranslation(bool translation) {
+    cpu.translation = translation;
+}
+
+void Bus::setIdleSkip(bool idleSkip) {
+    this->idleSkip = idleSkip;
+    cpu.idleDetection = idleSkip;
+}
+
+void Bus::setLineRendering(bool lineRendering) {
+    ppu.lineRendering = lineRendering;
+    follow();
+}
+
+void Bus::setSpriteIndex(bool spriteIndex) {
+    ppu.spriteIndex = spriteIndex;
+    follow();
+}
+
+void Bus::setFrameSkip(uint32_t frameSkip) {
+    // Every frame is output if frames are not skipped.
+    ppu.frameSkip = std::max<uint32_t>(frameSkip, 1);
+    follow();
+}
+
+void Bus::setFrameReuse(bool frameReuse) {
+    ppu.frameReuse = frameReuse;
+    follow();
 }
 
-uint8_t Bus::read(uint16_t addr) {
-    if (addr <= 0x1FFF) {
-        // CPU RAM.
-        return ram[addr & 0x07FF];
-    } else if (addr <= 0x3FFF) {
-        // PPU registers.
-        return ppu.registerRead(addr & 0x2007);
-    } else if (addr <= 0x4013) {
+void Bus::setPipelining(bool pipelining) {
+    pipeliningEnabled = pipelining;
+    updatePipelining();
+}
+
+void Bus::updatePipelining() {
+    // The renderer would decode CHR-RAM while the CPU thread writes it.
+    bool pipelining = pipeliningEnabled && !(cart && cart->chrWritable());
+
+    sync();
+    this->pipelining = pipelining;
+
+    // The PPU of the bus only keeps the timing while the renderer outputs the frames.
+    if (pipelining) {
+        ppu.setOutput(false);
+        follow();
+    } else {
+        pipeline.stop(ppuClock, ppu.status());
+        ppu.setOutput(true);
+    }
+}
+
+void Bus::setRenderWorkers(uint8_t workers) {
+    pipeline.setWorkers(workers);
+}
+
+void Bus::follow() {
+    if (pipelining) pipeline.start(ppu, ppuClock);
+}
+
+void Bus::watch(uint16_t addr) {
+    // Only RAM can be written, cartridge writes go to the mapper.
+    if (addr > 0x1FFF) return;
+
+    // Watch the page in all mirrors of the RAM.
+    for (uint16_t page = (addr >> 8) & 0x07; page <= 0x1F; page += 0x08) {
+        pages[page].write = nullptr;
+        pages[page].writeHandler = &Bus::codeWrite;
+    }
+}
+
+#ifdef NES_PROFILE
+void Bus::dumpProfile(std::ostream &out) {
+    out << "{\"cpu\": ";
+    cpu.dumpProfile(out);
+    out << ", \"ppu\": ";
+    ppu.dumpProfile(out);
+    out << "}\n";
+}
+#endif // NES_PROFILE
+
+void Bus::mapCart() {
+    // 0x4020-0x40FF shares a page with the I/O registers and is handled by them.
+    for (uint16_t page = 0x41; page <= 0xFF; page++) {
+        uint8_t *read = cart ? cart->prgPage(page << 8) : nullptr;
+
+        // Code decoded from the previous bank is stale.
+        if (read != pages[page].read) cpu.invalidate(page << 8);
+
+        pages[page].read = read;
+        pages[page].write = nullptr;
+        pages[page].readHandler = &Bus::cartRead;
+        pages[page].writeHandler = &Bus::cartWrite;
+    }
+}
+
+void Bus::mapChr() {
+    // The PPU has to render everything before the switch with the previous banks.
+    sync();
+    ppu.mapChr();
+
+    if (!pipelining) return;
+
+    for (uint8_t bank = 0; bank < 8; bank++) {
+        uint8_t *source = cart ? cart->chrBank(bank << 10) : nullptr;
+        pipeline.record(ppuClock, Pipeline::Kind::CHR, bank, 0x00, source);
+    }
+}
+
+void Bus::mapNametables() {
+    // The PPU has to render everything before the switch with the previous layout.
+    sync();
+    ppu.mapNametables();
+
+    if (!pipelining) return;
+
+    // The renderer has nametables in its own VRAM.
+    for (uint8_t table = 0; table < 4; table++) {
+        uint8_t *memory = pipeline.lookupNametable(table);
+        pipeline.record(ppuClock, Pipeline::Kind::NAMETABLE, table, 0x00, memory);
+    }
+}
+
+void Bus::mapPages() {
+    // CPU RAM and mirrors.
+    for (uint16_t page = 0x00; page <= 0x1F; page++) {
+        pages[page].read = &ram[(page & 0x07) << 8];
+        pages[page].write = &ram[(page & 0x07) << 8];
+    }
+
+    // PPU registers and mirrors.
+    for (uint16_t page = 0x20; page <= 0x3F; page++) {
+        pages[page].readHandler = &Bus::ppuRead;
+        pages[page].writeHandler = &Bus::ppuWrite;
+    }
+
+    // APU and I/O registers.
+    pages[0x40].readHandler = &Bus::ioRead;
+    pages[0x40].writeHandler = &Bus::ioWrite;
+
+    mapCart();
+}
+
+uint8_t Bus::ppuRead(uint16_t addr) {
+    sync();
+
+    // Reading PPUSTATUS or PPUDATA changes the state of the PPU.
+    if (pipelining && ((addr & 0x0007) == 0x0002 || (addr & 0x0007) == 0x0007)) {
+        pipeline.record(ppuClock, Pipeline::Kind::READ, addr & 0x2007);
+    }
+
+    return ppu.registerRead(addr & 0x2007);
+}
+
+void Bus::ppuWrite(uint16_t addr, uint8_t data) {
+    sync();
+    ppu.registerWrite(addr & 0x2007, data);
+
+    if (pipelining) pipeline.record(ppuClock, Pipeline::Kind::WRITE, addr & 0x2007, data);
+}
+
+uint8_t Bus::ioRead(uint16_t addr) {
+    if (addr <= 0x4013) {
         // APU registers.
         return apu.read(addr);
     } else if (addr == 0x4014) {
@@ -142,27 +485,14 @@ uint8_t Bus::read(uint16_t addr) {
         } else {
             return 0x00;
         }
-    } else if (addr <= 0xFFFF) {
-        // Read from cartridge
-        if (cart) {
-            return cart->cpuRead(addr);
-        } else {
-            return 0x00;
-        }
     } else {
-        // Never reached.
-        return 0x00;
+        // Read from cartridge
+        return cartRead(addr);
     }
 }
 
-void Bus::write(uint16_t addr, uint8_t data) {
-    if (addr <= 0x1FFF) {
-        // CPU RAM.
-        ram[addr & 0x07FF] = data;
-    } else if (addr <= 0x3FFF) {
-        // PPU registers.
-        ppu.registerWrite(addr & 0x2007, data);
-    } else if (addr <= 0x4013) {
+void Bus::ioWrite(uint16_t addr, uint8_t data) {
+    if (addr <= 0x4013) {
         // APU registers.
         apu.write(addr, data);
     } else if (addr == 0x4014) {
@@ -178,9 +508,34 @@ void Bus::write(uint16_t addr, uint8_t data) {
     } else if (addr == 0x4017) {
         // APU frame counter.
         apu.write(addr, data);
-    } else if (addr <= 0xFFFF) {
+    } else {
         // Write to cartridge.
-        if (cart) cart->cpuWrite(addr, data);
+        cartWrite(addr, data);
+    }
+}
+
+uint8_t Bus::cartRead(uint16_t addr) {
+    if (cart) {
+        return cart->cpuRead(addr);
+    } else {
+        return 0x00;
+    }
+}
+
+void Bus::cartWrite(uint16_t addr, uint8_t data) {
+    // The mapper might switch CHR banks or the nametable layout used by the PPU.
+    sync();
+
+    if (cart) cart->cpuWrite(addr, data);
+}
+
+void Bus::codeWrite(uint16_t addr, uint8_t data) {
+    ram[addr & 0x07FF] = data;
+
+    // Stop watching the page and drop the code translated from it in all mirrors of the RAM.
+    for (uint16_t page = (addr >> 8) & 0x07; page <= 0x1F; page += 0x08) {
+        pages[page].write = &ram[(page & 0x07) << 8];
+        cpu.invalidate(page << 8);
     }
 }
 
@@ -193,6 +548,23 @@ void Bus::dmaInit(uint8_t page) {
     dmaLower = 0x00;
 }
 
+uint16_t Bus::dma() {
+    uint16_t cycles = 0;
+
+    // One byte is transferred every other cycle, plus one cycle if DMA has to wait for a read 
+    // cycle, and one more to end. Each write to OAM lands at the dot of its cycle, since the PPU 
+    // catches up before it.
+    dmaTransfer();
+    while (dmaActive) {
+        cpu.tick();
+        clock += 3;
+        cycles++;
+        dmaTransfer();
+    }
+
+    return cycles;
+}
+
 void Bus::dmaTransfer() {
     if (!dmaWait) {
         cpu.suspended = false;
@@ -210,7 +582,9 @@ void Bus::dmaTransfer() {
         dmaLower++;
     }
     if (!dmaRead && !cpu.dmaRead) {
+        sync();
         ppu.dmaWrite(dmaData);
+        if (pipelining) pipeline.record(ppuClock, Pipeline::Kind::DMA, 0x2004, dmaData);
         dmaRead = true;
 
         // CPU can only be unhalted on DMA read cycles.
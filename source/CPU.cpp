@@ -1,4 +1,10 @@
 #include <cstdint>
+#include <array>
+#include <memory>
+#include <ostream>
+#include <map>
+#include <string>
+#include <utility>
 
 #include "CPU.h"
 #include "Bus.h"
@@ -9,7 +15,7 @@ using std::uint8_t;
 void CPU::tick() {
     // If a KIL instruction is called the CPU should halt.
     // TODO: Make KIL have one wait cycle.
-    if (op == &CPU::KIL) return;
+    if (halted) return;
 
     // CPU switches being allowing DMA to read or write each cycle.
     dmaRead = !dmaRead;
@@ -23,6 +29,110 @@ void CPU::tick() {
         return;
     }
 
+    step();
+}
+
+uint16_t CPU::stepInstruction() {
+    // A halted CPU does nothing, but time still passes.
+    if (halted) return 0x0001;
+
+    // If the CPU is suspended only update DMA read/write.
+    if (suspended) {
+        dmaRead = !dmaRead;
+        return 0x0001;
+    }
+
+    return runInstruction();
+}
+
+uint64_t CPU::run(uint64_t budget) {
+    // A halted CPU consumes the entire budget.
+    if (halted) {
+        bus->elapse(budget);
+        return budget;
+    }
+
+    uint64_t cycles = 0;
+
+    // Only an instruction can halt or suspend the CPU, which ends the burst. It also ends when an 
+    // event is due, like an NMI which has to be triggered before the next instruction.
+    while (cycles < budget && !halted && !suspended && !bus->due()) {
+        // Run a translated block if all of its cycles fit in the budget.
+        if (translation && wait == 0x00 && delayed == nullptr) {
+            Block *block = lookup();
+
+            if (block && cycles + block->maxCycles <= budget) {
+                cycles += runBlock(*block);
+                continue;
+            }
+        }
+
+        uint16_t spent = runInstruction();
+        bus->elapse(spent);
+        cycles += spent;
+
+        // The bus might skip iterations of an idle loop from its head.
+        if (idleDetection && idleLoop().head) break;
+    }
+
+    return cycles;
+}
+
+uint16_t CPU::runInstruction() {
+    uint16_t start = pc;
+    bool interrupted = delayed != nullptr;
+
+    // Consume the cycles remaining of the current instruction.
+    uint16_t cycles = wait + 1;
+    wait = 0x00;
+
+    // Perform the next instruction.
+    step();
+
+    // If the instruction suspended the CPU its remaining cycles are consumed after the DMA.
+    if (!suspended) {
+        cycles += wait;
+        wait = 0x00;
+    }
+
+    // CPU switches being allowing DMA to read or write each cycle.
+    if (cycles & 0x0001) dmaRead = !dmaRead;
+
+    if (idleDetection) track(start, interrupted, cycles);
+
+    return cycles;
+}
+
+void CPU::invalidate(uint16_t addr) {
+    uint8_t index = addr >> 8;
+
+    // Instructions at the end of the previous page might have operands in the page.
+    std::unique_ptr<DecodedPage> &previous = decoded[(index - 1) & 0xFF];
+    if (previous) {
+        (*previous)[0xFE].length = 0;
+        (*previous)[0xFF].length = 0;
+    }
+
+    if (decoded[index]) {
+        for (Decoded &instruction : *decoded[index]) instruction.length = 0;
+    }
+
+    // Instructions are kept since the invalidated block might be running.
+    if (blocks[index]) {
+        for (Block &block : *blocks[index]) {
+            block.source = nullptr;
+            block.heat = 0x00;
+        }
+    }
+
+    invalidated = true;
+}
+
+bool CPU::done() {
+    return wait == 0x00 && !suspended;
+}
+
+void CPU::step() {
     // Trigger delayed interrupts.
     if (delayed != nullptr) {
         (this->*delayed)();
@@ -32,21 +142,23 @@ void CPU::tick() {
         return;
     }
 
-    // Fetch the opcode.
-    opcode = read(pc++);
-
-    // Fetch addressing mode, operation and the cycles need to perform the opcode.
-    addrMode = opcodes[opcode].addrMode;
-    op = opcodes[opcode].op;
-    wait = opcodes[opcode].cycles;
+    // Fetch the decoded opcode and operands.
+    Decoded const &instruction = decode();
+    current = &instruction;
+    opcode = instruction.opcode;
+    operand = instruction.operand;
+    pc++;
 
-    // Fetch address from addressing mode.
-    (this->*addrMode)();
+    // Fetch the cycles needed to perform the opcode.
+    wait = instruction.cycles;
 
-    // Perform the operation.
-    (this->*op)();
+    // Fetch address from addressing mode and perform the operation.
+    dispatch(instruction.opcode);
 
     // Add oops cycle if there was one.
+    #ifdef NES_PROFILE
+    if (oops) profile.oops[opcode]++;
+    #endif
     if (oops) wait++;
     oops = false;
 
@@ -66,13 +178,12 @@ void CPU::power() {
     pc = (high << 8) | low;
 
     s = 0xFD;
-    p.status = 0b00100100;
+    setStatus(0b00100100);
 
     // Clean up helper members.
     wait = 0x00;
     oops = false;
-    addrMode = nullptr;
-    op = nullptr;
+    halted = false;
 }
 
 void CPU::reset() {
@@ -91,8 +202,7 @@ void CPU::reset() {
     // Clean up helper members.
     wait = 0x00;
     oops = false;
-    addrMode = nullptr;
-    op = nullptr;
+    halted = false;
 
     // Reset takes time.
     wait = 7;
@@ -155,9 +265,9 @@ void CPU::interrupt(uint16_t addr, bool brk) {
 
     // Push the status register with the B flag set.
     if (brk) {
-        push(p.status | 0x10);
+        push(getStatus() | 0x10);
     } else {
-        push(p.status);
+        push(getStatus());
     }
 
     // Disable interrupts
@@ -169,6 +279,26 @@ void CPU::interrupt(uint16_t addr, bool brk) {
     pc = (high << 8) | low;
 }
 
+uint8_t CPU::getStatus() {
+    // Materialize the lazy flags.
+    p.C = carry;
+    p.Z = zero == 0x00;
+    p.V = overflow & 0x80;
+    p.N = negative & 0x80;
+
+    return p.status;
+}
+
+void CPU::setStatus(uint8_t status) {
+    p.status = status;
+
+    // Keep the flags lazily.
+    carry = p.C;
+    zero = !p.Z;
+    overflow = p.V << 7;
+    negative = p.N << 7;
+}
+
 void CPU::branch() {
     // PC = PC + 2 + memory (signed)
     // +2 happens in relative addressing mode method.
@@ -177,8 +307,8 @@ void CPU::branch() {
     // There is an extra cycle since the branch was taken.
     wait++;
 
-    // If pc crossed a page there is an extra cycle.
-    if (crossed(pc, res)) wait++;
+    // If pc crossed a page there is an extra cycle, which is known when the branch is decoded.
+    if (current->crosses) wait++;
 
     pc = res;
 }
@@ -188,18 +318,18 @@ bool CPU::crossed(uint16_t arg, uint16_t addr) {
 }
 
 void CPU::ZPX() {
-    uint16_t arg = read(pc++);
+    uint16_t arg = fetch();
     opAddr = (arg + x) & 0x00FF;
 }
 
 void CPU::ZPY() {
-    uint16_t arg = read(pc++);
+    uint16_t arg = fetch();
     opAddr = (arg + y) & 0x00FF;
 }
 
 void CPU::ABX() {
-    uint16_t low = read(pc++);
-    uint16_t high = read(pc++);
+    uint16_t low = fetch();
+    uint16_t high = fetch();
     uint16_t arg = (high << 8) | low;
     opAddr = arg + x;
 
@@ -208,8 +338,8 @@ void CPU::ABX() {
 }
 
 void CPU::ABY() {
-    uint16_t low = read(pc++);
-    uint16_t high = read(pc++);
+    uint16_t low = fetch();
+    uint16_t high = fetch();
     uint16_t arg = (high << 8) | low;
     opAddr = arg + y;
 
@@ -218,14 +348,14 @@ void CPU::ABY() {
 }
 
 void CPU::IDX() {
-    uint16_t arg = read(pc++);
+    uint16_t arg = fetch();
     uint16_t low = read((arg + x) & 0x00FF);
     uint16_t high = read((arg + x + 1) & 0x00FF);
     opAddr = (high << 8) | low;
 }
 
 void CPU::IDY() {
-    uint16_t arg = read(pc++);
+    uint16_t arg = fetch();
     uint16_t low = read(arg);
     uint16_t high = read((arg + 1) & 0x00FF);
     opAddr = ((high << 8) | low) + y;
@@ -248,18 +378,18 @@ void CPU::IMM() {
 }
 
 void CPU::ZP0() {
-    uint16_t arg = read(pc++);
+    uint16_t arg = fetch();
     opAddr = arg & 0x00FF;
 }
 
 void CPU::ABS() {
-    uint16_t low = read(pc++);
-    uint16_t high = read(pc++);
+    uint16_t low = fetch();
+    uint16_t high = fetch();
     opAddr = (high << 8) | low;
 }
 
 void CPU::REL() {
-    opAddr = read(pc++);
+    opAddr = fetch();
 
     // If the 8:th bit is set the offset is negative.
     if (opAddr & 0x80) {
@@ -269,8 +399,8 @@ void CPU::REL() {
 
 void CPU::IND() {
     // NOTE: bug described by https://forums.nesdev.org/viewtopic.php?t=15587
-    uint16_t ptr_low = read(pc++);
-    uint16_t ptr_high = read(pc++);
+    uint16_t ptr_low = fetch();
+    uint16_t ptr_high = fetch();
     uint16_t ptr = (ptr_high << 8) | ptr_low;
     uint16_t low = read(ptr);
     uint16_t high = read(ptr + 1);
@@ -287,13 +417,13 @@ void CPU::IND() {
 void CPU::ADC() {
     // A = A + memory + C
     uint8_t mem = read(opAddr);
-    uint16_t res = a + mem + p.C;
+    uint16_t res = a + mem + carry;
 
     // Set affected flags.
-    p.C = res & 0xFF00;
-    p.Z = !(res & 0x00FF);
-    p.V = (res ^ a) & (res ^ mem) & 0x0080;
-    p.N = res & 0x0080;
+    carry = res & 0xFF00;
+    zero = res;
+    overflow = (res ^ a) & (res ^ mem);
+    negative = res;
 
     a = res & 0xFF;
 }
@@ -304,16 +434,17 @@ void CPU::AND() {
     uint8_t res = a & mem;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     a = res;
 }
 
+template <bool ACCUMULATOR>
 void CPU::ASL() {
     // value = value << 1
     uint8_t val = 0x00;
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         val = a;
     } else {
         val = read(opAddr);
@@ -322,11 +453,11 @@ void CPU::ASL() {
     uint8_t res = val << 1;
 
     // Set affected flags.
-    p.C = val & 0x80;
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    carry = val & 0x80;
+    zero = res;
+    negative = res;
 
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         a = res;
     } else {
         write(opAddr, res);
@@ -338,17 +469,17 @@ void CPU::ASL() {
 
 void CPU::BCC() {
     // Branch if C is clear.
-    if (!p.C) branch();
+    if (!carry) branch();
 }
 
 void CPU::BCS() {
     // Branch if C is set.
-    if (p.C) branch();
+    if (carry) branch();
 }
 
 void CPU::BEQ() {
     // Branch if Z is set.
-    if (p.Z) branch();
+    if (zero == 0x00) branch();
 }
 
 void CPU::BIT() {
@@ -357,24 +488,24 @@ void CPU::BIT() {
     uint8_t res = a & mem;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.V = mem & 0x40;
-    p.N = mem & 0x80;
+    zero = res;
+    overflow = mem << 1;
+    negative = mem;
 }
 
 void CPU::BMI() {
     // Branch if N is set.
-    if (p.N) branch();
+    if (negative & 0x80) branch();
 }
 
 void CPU::BNE() {
     // Branch if Z is clear.
-    if (!p.Z) branch();
+    if (zero != 0x00) branch();
 }
 
 void CPU::BPL() {
     // Branch if N is clear.
-    if (!p.N) branch();
+    if (!(negative & 0x80)) branch();
 }
 
 void CPU::BRK() {
@@ -384,17 +515,17 @@ void CPU::BRK() {
 
 void CPU::BVC() {
     // Branch if V is clear.
-    if (!p.V) branch();
+    if (!(overflow & 0x80)) branch();
 }
 
 void CPU::BVS() {
     // Branch if V is set.
-    if (p.V) branch();
+    if (overflow & 0x80) branch();
 }
 
 void CPU::CLC() {
     // C = 0
-    p.C = 0;
+    carry = 0;
 }
 
 void CPU::CLD() {
@@ -409,7 +540,7 @@ void CPU::CLI() {
 
 void CPU::CLV() {
     // V = 0
-    p.V = 0;
+    overflow = 0x00;
 }
 
 void CPU::CMP() {
@@ -418,9 +549,9 @@ void CPU::CMP() {
     uint8_t res = a - mem;
 
     // Set affected flags.
-    p.C = a >= mem;
-    p.Z = a == mem;
-    p.N = res & 0x80;
+    carry = a >= mem;
+    zero = res;
+    negative = res;
 }
 
 void CPU::CPX() {
@@ -429,9 +560,9 @@ void CPU::CPX() {
     uint8_t res = x - mem;
 
     // Set affected flags.
-    p.C = x >= mem;
-    p.Z = x == mem;
-    p.N = res & 0x80;
+    carry = x >= mem;
+    zero = res;
+    negative = res;
 }
 
 void CPU::CPY() {
@@ -440,9 +571,9 @@ void CPU::CPY() {
     uint8_t res = y - mem;
 
     // Set affected flags.
-    p.C = y >= mem;
-    p.Z = y == mem;
-    p.N = res & 0x80;
+    carry = y >= mem;
+    zero = res;
+    negative = res;
 }
 
 void CPU::DEC() {
@@ -451,8 +582,8 @@ void CPU::DEC() {
     uint8_t res = mem - 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     write(opAddr, res);
 
@@ -465,8 +596,8 @@ void CPU::DEX() {
     uint8_t res = x - 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     x = res;
 }
@@ -476,8 +607,8 @@ void CPU::DEY() {
     uint8_t res = y - 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     y = res;
 }
@@ -488,8 +619,8 @@ void CPU::EOR() {
     uint8_t res = a ^ mem;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     a = res;
 }
@@ -500,8 +631,8 @@ void CPU::INC() {
     uint8_t res = mem + 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     write(opAddr, res);
 
@@ -514,8 +645,8 @@ void CPU::INX() {
     uint8_t res = x + 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     x = res;
 }
@@ -525,8 +656,8 @@ void CPU::INY() {
     uint8_t res = y + 1;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     y = res;
 }
@@ -551,8 +682,8 @@ void CPU::LDA() {
     uint8_t mem = read(opAddr);
 
     // Set affected flags.
-    p.Z = mem == 0x00;
-    p.N = mem & 0x80;
+    zero = mem;
+    negative = mem;
 
     a = mem;
 }
@@ -562,8 +693,8 @@ void CPU::LDX() {
     uint8_t mem = read(opAddr);
 
     // Set affected flags.
-    p.Z = mem == 0x00;
-    p.N = mem & 0x80;
+    zero = mem;
+    negative = mem;
 
     x = mem;
 }
@@ -573,16 +704,17 @@ void CPU::LDY() {
     uint8_t mem = read(opAddr);
 
     // Set affected flags.
-    p.Z = mem == 0x00;
-    p.N = mem & 0x80;
+    zero = mem;
+    negative = mem;
 
     y = mem;
 }
 
+template <bool ACCUMULATOR>
 void CPU::LSR() {
     // value = value >> 1
     uint8_t val = 0x00;
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         val = a;
     } else {
         val = read(opAddr);
@@ -591,11 +723,11 @@ void CPU::LSR() {
     uint8_t res = val >> 1;
 
     // Set affected flags.
-    p.C = val & 0x01;
-    p.Z = res == 0x00;
-    p.N = 0;
+    carry = val & 0x01;
+    zero = res;
+    negative = 0x00;
 
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         a = res;
     } else {
         write(opAddr, res);
@@ -615,8 +747,8 @@ void CPU::ORA() {
     uint8_t res = a | mem;
 
     // Set affected flags.
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    zero = res;
+    negative = res;
 
     a = res;
 }
@@ -628,7 +760,7 @@ void CPU::PHA() {
 
 void CPU::PHP() {
     // Push status register.
-    push(p.status | 0x10); // Push with B flag set.
+    push(getStatus() | 0x10); // Push with B flag set.
 }
 
 void CPU::PLA() {
@@ -636,34 +768,35 @@ void CPU::PLA() {
     a = pop();
 
     // Set affected flags.
-    p.Z = a == 0x00;
-    p.N = a & 0x80;
+    zero = a;
+    negative = a;
 }
 
 void CPU::PLP() {
     // Pop into status register.
-    p.status = pop();
+    setStatus(pop());
     p.B = 0; // Pop with B flag ignored.
     p.U = 1; // Pop with unused flag set.
 }
 
+template <bool ACCUMULATOR>
 void CPU::ROL() {
     // value = value << 1 through C
     uint8_t val = 0x00;
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         val = a;
     } else {
         val = read(opAddr);
     }
 
-    uint8_t res = (val << 1) | p.C;
+    uint8_t res = (val << 1) | carry;
 
     // Set affected flags.
-    p.C = val & 0x80;
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    carry = val & 0x80;
+    zero = res;
+    negative = res;
 
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         a = res;
     } else {
         write(opAddr, res);
@@ -673,23 +806,24 @@ void CPU::ROL() {
     oops = false;
 }
 
+template <bool ACCUMULATOR>
 void CPU::ROR() {
     // value = value >> 1 through C
     uint8_t val = 0x00;
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         val = a;
     } else {
         val = read(opAddr);
     }
 
-    uint8_t res = (p.C << 7) | (val >> 1);
+    uint8_t res = (carry << 7) | (val >> 1);
 
     // Set affected flags.
-    p.C = val & 0x01;
-    p.Z = res == 0x00;
-    p.N = res & 0x80;
+    carry = val & 0x01;
+    zero = res;
+    negative = res;
 
-    if (addrMode == &CPU::ACC) {
+    if constexpr (ACCUMULATOR) {
         a = res;
     } else {
         write(opAddr, res);
@@ -701,7 +835,7 @@ void CPU::ROR() {
 
 void CPU::RTI() {
     // Pop status register.
-    p.status = pop();
+    setStatus(pop());
     p.B = 0; // Pop with B flag ignored.
     p.U = 1; // Pop with unused flag set.
 
@@ -724,20 +858,20 @@ void CPU::RTS() {
 void CPU::SBC() {
     // A = A - memory - ~C
     uint8_t mem = read(opAddr);
-    uint16_t res = a + (mem ^ 0xFF) + p.C;
+    uint16_t res = a + (mem ^ 0xFF) + carry;
 
     // Set affected flags.
-    p.C = res & 0xFF00;
-    p.Z = !(res & 0x00FF);
-    p.V = (res ^ a) & (res ^ (mem ^ 0xFF)) & 0x0080;
-    p.N = res & 0x0080;
+    carry = res & 0xFF00;
+    zero = res;
+    overflow = (res ^ a) & (res ^ (mem ^ 0xFF));
+    negative = res;
 
     a = res;
 }
 
 void CPU::SEC() {
     // C = 1
-    p.C = 1;
+    carry = 1;
 }
 
 void CPU::SED() {
@@ -773,8 +907,8 @@ void CPU::TAX() {
     x = a;
 
     // Set affected flags.
-    p.Z = x == 0x00;
-    p.N = x & 0x80;
+    zero = x;
+    negative = x;
 }
 
 void CPU::TAY() {
@@ -782,8 +916,8 @@ void CPU::TAY() {
     y = a;
 
     // Set affected flags.
-    p.Z = y == 0x00;
-    p.N = y & 0x80;
+    zero = y;
+    negative = y;
 }
 
 void CPU::TSX() {
@@ -791,8 +925,8 @@ void CPU::TSX() {
     x = s;
 
     // Set affected flags.
-    p.Z = x == 0x00;
-    p.N = x & 0x80;
+    zero = x;
+    negative = x;
 }
 
 void CPU::TXA() {
@@ -800,8 +934,8 @@ void CPU::TXA() {
     a = x;
 
     // Set affected flags.
-    p.Z = a == 0x00;
-    p.N = a & 0x80;
+    zero = a;
+    negative = a;
 }
 
 void CPU::TXS() {
@@ -814,8 +948,8 @@ void CPU::TYA() {
     a = y;
 
     // Set affected flags.
-    p.Z = a == 0x00;
-    p.N = a & 0x80;
+    zero = a;
+    negative = a;
 }
 
 // TODO: Most of the illegal opcodes are not implemented correctly
@@ -842,7 +976,7 @@ void CPU::ANC() {
     // AND();
 
     // // Set affected flags.
-    // p.C = a & 0x80;
+    // carry = a & 0x80;
 }
 
 void CPU::ARR() {
@@ -851,7 +985,7 @@ void CPU::ARR() {
     // ROR();
 
     // // Set affected flags.
-    // p.V = (a ^ (a << 1)) & 0x40;
+    // overflow = (a ^ (a << 1)) << 1;
 }
 
 void CPU::AXS() {
@@ -861,9 +995,9 @@ void CPU::AXS() {
     // uint16_t res = (a & x) - mem;
 
     // // Set affected flags.
-    // p.C = (a & x) >= mem;
-    // p.Z = (a & x) == mem;
-    // p.N = res & 0x80;
+    // carry = (a & x) >= mem;
+    // zero = res;
+    // negative = res;
     
     // x = res;
 }
@@ -888,6 +1022,7 @@ void CPU::ISC() {
 
 void CPU::KIL() {
     // Freezes the CPU.
+    halted = true;
 }
 
 void CPU::LAS() {
@@ -897,18 +1032,19 @@ void CPU::LAS() {
     // uint8_t res = s & mem;
 
     // // Set affected flags.
-    // p.Z = res == 0x00;
-    // p.N = res & 0x80;
+    // zero = res;
+    // negative = res;
 
     // a = res;
     // x = res;
     // s = res;
 }
 
+template <bool IMMEDIATE>
 void CPU::LAX() {
     // A = memory, then X = memory or X = A
     LDA();
-    if (addrMode == &CPU::IMM) {
+    if constexpr (IMMEDIATE) {
         TAX();
     } else {
         LDX();
@@ -1001,4 +1137,414 @@ void CPU::XAA() {
     // A = X, then A = A & memory
     // TXA();
     // AND();
-}
\ No newline at end of file
+}
+
+template <uint8_t OPCODE>
+void CPU::execute() {
+    constexpr Lookup entry = opcodes[OPCODE];
+
+    // Fetch address from addressing mode.
+    (this->*entry.addrMode)();
+
+    // Perform the operation.
+    (this->*entry.op)();
+}
+
+void CPU::dispatch(uint8_t opcode) {
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.opcodes[opcode]);
+    #endif
+
+    #define CPU_CASE(OPCODE) case OPCODE: execute<OPCODE>(); return;
+    #define CPU_ROW(ROW) \
+        CPU_CASE(ROW | 0x00) CPU_CASE(ROW | 0x01) CPU_CASE(ROW | 0x02) CPU_CASE(ROW | 0x03) \
+        CPU_CASE(ROW | 0x04) CPU_CASE(ROW | 0x05) CPU_CASE(ROW | 0x06) CPU_CASE(ROW | 0x07) \
+        CPU_CASE(ROW | 0x08) CPU_CASE(ROW | 0x09) CPU_CASE(ROW | 0x0A) CPU_CASE(ROW | 0x0B) \
+        CPU_CASE(ROW | 0x0C) CPU_CASE(ROW | 0x0D) CPU_CASE(ROW | 0x0E) CPU_CASE(ROW | 0x0F)
+
+    switch (opcode) {
+        CPU_ROW(0x00) CPU_ROW(0x10) CPU_ROW(0x20) CPU_ROW(0x30)
+        CPU_ROW(0x40) CPU_ROW(0x50) CPU_ROW(0x60) CPU_ROW(0x70)
+        CPU_ROW(0x80) CPU_ROW(0x90) CPU_ROW(0xA0) CPU_ROW(0xB0)
+        CPU_ROW(0xC0) CPU_ROW(0xD0) CPU_ROW(0xE0) CPU_ROW(0xF0)
+    }
+
+    #undef CPU_ROW
+    #undef CPU_CASE
+}
+
+CPU::Decoded const &CPU::decodeMiss() {
+    std::unique_ptr<DecodedPage> &page = decoded[pc >> 8];
+
+    stats.misses++;
+
+    decode(uncached, pc);
+
+    // Instructions with any byte in memory mapped I/O are decoded every time.
+    if (!bus || bus->host(pc) == nullptr || bus->host(pc + 2) == nullptr) return uncached;
+
+    if (!page) page = std::make_unique<DecodedPage>();
+    Decoded &instruction = (*page)[pc & 0x00FF];
+    instruction = uncached;
+
+    // Writes to RAM holding the instruction has to invalidate it.
+    bus->watch(pc);
+    bus->watch(pc + 2);
+
+    return instruction;
+}
+
+void CPU::decode(Decoded &instruction, uint16_t addr) {
+    uint8_t byte = read(addr);
+    Lookup const &entry = opcodes[byte];
+
+    instruction.opcode = byte;
+    instruction.cycles = entry.cycles;
+    instruction.operand = 0x0000;
+    instruction.length = 1;
+    instruction.crosses = false;
+
+    // Read the operand bytes. Immediate operands are read by the operation itself.
+    if (entry.addrMode == &CPU::IMM) {
+        instruction.length = 2;
+    } else if (
+        entry.addrMode == &CPU::ZP0 || entry.addrMode == &CPU::ZPX || entry.addrMode == &CPU::ZPY ||
+        entry.addrMode == &CPU::IDX || entry.addrMode == &CPU::IDY || entry.addrMode == &CPU::REL
+    ) {
+        instruction.operand = read(addr + 1);
+        instruction.length = 2;
+    } else if (
+        entry.addrMode == &CPU::ABS || entry.addrMode == &CPU::ABX || 
+        entry.addrMode == &CPU::ABY || entry.addrMode == &CPU::IND
+    ) {
+        uint16_t low = read(addr + 1);
+        uint16_t high = read(addr + 2);
+        instruction.operand = (high << 8) | low;
+        instruction.length = 3;
+    }
+
+    // Branches are relative to the next instruction.
+    if (entry.addrMode == &CPU::REL) {
+        uint16_t next = addr + 2;
+        uint16_t offset = instruction.operand;
+
+        // If the 8:th bit is set the offset is negative.
+        if (offset & 0x80) {
+            offset = offset | 0xFF00;
+        }
+
+        instruction.crosses = crossed(next, next + offset);
+    }
+}
+
+CPU::Block *CPU::lookup() {
+    // Times a block has to be entered before it is translated.
+    uint8_t const THRESHOLD = 0x08;
+
+    // Memory mapped I/O is never translated.
+    uint8_t const *source = bus ? bus->host(pc) : nullptr;
+    if (source == nullptr) return nullptr;
+
+    std::unique_ptr<BlockPage> &page = blocks[pc >> 8];
+    if (!page) page = std::make_unique<BlockPage>();
+    Block &block = (*page)[pc & 0x00FF];
+
+    // The block is valid if it was translated from the same host memory.
+    if (block.source != source) {
+        // A block translated from another bank has to heat up again.
+        if (block.source != nullptr) {
+            block.source = nullptr;
+            block.heat = 0x00;
+        }
+
+        block.heat++;
+        if (block.heat < THRESHOLD) return nullptr;
+
+        translate(block, source);
+    }
+
+    // Empty blocks, like those starting with a KIL, are never run.
+    if (block.instructions.empty()) return nullptr;
+
+    return &block;
+}
+
+void CPU::translate(Block &block, uint8_t const *source) {
+    block.source = source;
+    block.instructions.clear();
+    block.cycles = 0;
+    block.maxCycles = 0;
+
+    uint16_t addr = pc;
+
+    // Instructions which might continue on the next page end the block before them, since the 
+    // next page might be mapped to another bank.
+    while (block.instructions.size() < 0x20 && (addr & 0x00FF) <= 0xFD) {
+        Decoded instruction;
+        decode(instruction, addr);
+        Lookup const &entry = opcodes[instruction.opcode];
+
+        // KIL halts the CPU which is left to the interpreter.
+        if (entry.op == &CPU::KIL) break;
+
+        block.instructions.push_back(instruction);
+        block.cycles += entry.cycles;
+        block.maxCycles += entry.cycles;
+
+        // Indexed addressing might add an oops cycle and taken branches up to two cycles.
+        if (entry.addrMode == &CPU::ABX || entry.addrMode == &CPU::ABY || entry.addrMode == &CPU::IDY) {
+            block.maxCycles += 1;
+        } else if (entry.addrMode == &CPU::REL) {
+            block.maxCycles += 2;
+        }
+
+        // Branches, jumps, returns and interrupts end the block.
+        if (entry.addrMode == &CPU::REL) break;
+        if (entry.op == &CPU::JMP || entry.op == &CPU::JSR) break;
+        if (entry.op == &CPU::RTS || entry.op == &CPU::RTI || entry.op == &CPU::BRK) break;
+
+        addr += instruction.length;
+    }
+
+    // Writes to RAM holding the block has to invalidate it.
+    if (bus) bus->watch(pc);
+}
+
+uint16_t CPU::runBlock(Block &block) {
+    uint16_t cycles = 0;
+    invalidated = false;
+
+    for (Decoded const &instruction : block.instructions) {
+        uint16_t start = pc;
+
+        // The instruction is already decoded.
+        current = &instruction;
+        opcode = instruction.opcode;
+        operand = instruction.operand;
+        pc++;
+        wait = instruction.cycles;
+
+        dispatch(instruction.opcode);
+
+        // Add oops cycle if there was one.
+        #ifdef NES_PROFILE
+        if (oops) profile.oops[opcode]++;
+        #endif
+        if (oops) wait++;
+        oops = false;
+
+        // If the instruction suspended the CPU its remaining cycles are consumed after the DMA.
+        if (suspended) {
+            cycles++;
+            wait--;
+            bus->elapse(1);
+            if (idleDetection) track(start, false, 1);
+            break;
+        }
+
+        // The bus has to be at the end of the instruction when the next one accesses the PPU.
+        cycles += wait;
+        bus->elapse(wait);
+        if (idleDetection) track(start, false, wait);
+        wait = 0x00;
+
+        // Stop if the instruction wrote to the code being run.
+        if (invalidated) break;
+    }
+
+    // CPU switches being allowing DMA to read or write each cycle.
+    if (cycles & 0x0001) dmaRead = !dmaRead;
+
+    return cycles;
+}
+
+CPU::DecodeStats CPU::decodeStats() {
+    return stats;
+}
+
+CPU::IdleLoop CPU::idleLoop() {
+    IdleLoop idle;
+
+    // A pending interrupt will leave the loop.
+    if (!loop.arrived || !loop.idle || delayed != nullptr) return idle;
+
+    idle.head = true;
+    idle.confirmed = loop.confirmed;
+    idle.status = loop.status;
+    idle.cycles = loop.cycles;
+
+    return idle;
+}
+
+void CPU::track(uint16_t start, bool interrupted, uint16_t cycles) {
+    loop.arrived = false;
+
+    // Interrupts and DMA leave the loop.
+    if (interrupted || suspended) {
+        loop = {};
+        return;
+    }
+
+    loop.elapsed += cycles;
+
+    // Only taken branches and absolute jumps backwards can close a loop.
+    Lookup const &entry = opcodes[current->opcode];
+    bool jump = entry.addrMode == &CPU::REL || (entry.op == &CPU::JMP && entry.addrMode == &CPU::ABS);
+
+    if (!jump || pc > start) {
+        // Leaving the loop stops tracking it.
+        if (pc < loop.head || pc > loop.end) loop = {};
+        return;
+    }
+
+    std::array<uint8_t, 5> state = {a, x, y, s, getStatus()};
+
+    if (pc == loop.head && start == loop.end) {
+        loop.confirmed = state == loop.state;
+        loop.cycles = loop.elapsed;
+    } else {
+        loop.head = pc;
+        loop.end = start;
+        loop.idle = polling(pc, start, loop.status);
+        loop.confirmed = false;
+        loop.cycles = 0;
+    }
+
+    loop.state = state;
+    loop.elapsed = 0;
+    loop.arrived = true;
+}
+
+bool CPU::polling(uint16_t head, uint16_t end, bool &status) {
+    // Instructions which neither write nor use the stack.
+    static constexpr std::array<void (CPU::*)(), 40> POLLING = {
+        &CPU::ADC, &CPU::AND, &CPU::ASL<true>, &CPU::BCC, &CPU::BCS, &CPU::BEQ, &CPU::BIT, &CPU::BMI,
+        &CPU::BNE, &CPU::BPL, &CPU::BVC, &CPU::BVS, &CPU::CLC, &CPU::CLD, &CPU::CLV, &CPU::CMP, 
+        &CPU::CPX, &CPU::CPY, &CPU::DEX, &CPU::DEY, &CPU::EOR, &CPU::INX, &CPU::INY, &CPU::JMP, 
+        &CPU::LDA, &CPU::LDX, &CPU::LDY, &CPU::LSR<true>, &CPU::NOP, &CPU::ORA, &CPU::ROL<true>, 
+        &CPU::ROR<true>, &CPU::SBC, &CPU::SEC, &CPU::SED, &CPU::TAX, &CPU::TAY, &CPU::TSX, &CPU::TXA, 
+        &CPU::TYA
+    };
+
+    status = false;
+
+    // Only short loops in host memory are checked.
+    if (end - head > 0x20 || !bus || !bus->host(head) || !bus->host(end + 2)) return false;
+
+    uint16_t addr = head;
+
+    while (true) {
+        Decoded instruction;
+        decode(instruction, addr);
+        Lookup const &entry = opcodes[instruction.opcode];
+
+        bool allowed = false;
+        for (void (CPU::*op)() : POLLING) allowed = allowed || entry.op == op;
+        if (!allowed) return false;
+
+        if (entry.addrMode == &CPU::ZP0 || entry.addrMode == &CPU::ABS) {
+            // Only host memory, which can't change by itself, and PPUSTATUS may be read.
+            if (entry.op == &CPU::JMP) {
+                // Jumps don't read their operand.
+            } else if ((instruction.operand & 0xE007) == 0x2002) {
+                status = true;
+            } else if (!bus->host(instruction.operand)) {
+                return false;
+            }
+        } else if (
+            entry.addrMode != &CPU::IMP && entry.addrMode != &CPU::ACC && 
+            entry.addrMode != &CPU::IMM && entry.addrMode != &CPU::REL
+        ) {
+            return false;
+        }
+
+        // The loop has to decode into instructions ending exactly at the jump.
+        if (addr == end) return true;
+        if (end - addr < instruction.length) return false;
+
+        addr += instruction.length;
+    }
+}
+
+#ifdef NES_PROFILE
+void CPU::dumpProfile(std::ostream &out) {
+    // Operations in the order they are declared, the names of the opcodes are looked up through their
+    // operation in the lookup table.
+    static constexpr std::array<std::pair<void (CPU::*)(), char const *>, 80> operations = {{
+        {&CPU::ADC, "ADC"}, {&CPU::AND, "AND"}, {&CPU::ASL, "ASL"}, {&CPU::BCC, "BCC"}, {&CPU::BCS, "BCS"}, {&CPU::BEQ, "BEQ"},
+        {&CPU::BIT, "BIT"}, {&CPU::BMI, "BMI"}, {&CPU::BNE, "BNE"}, {&CPU::BPL, "BPL"}, {&CPU::BRK, "BRK"}, {&CPU::BVC, "BVC"},
+        {&CPU::BVS, "BVS"}, {&CPU::CLC, "CLC"}, {&CPU::CLD, "CLD"}, {&CPU::CLI, "CLI"}, {&CPU::CLV, "CLV"}, {&CPU::CMP, "CMP"},
+        {&CPU::CPX, "CPX"}, {&CPU::CPY, "CPY"}, {&CPU::DEC, "DEC"}, {&CPU::DEX, "DEX"}, {&CPU::DEY, "DEY"}, {&CPU::EOR, "EOR"},
+        {&CPU::INC, "INC"}, {&CPU::INX, "INX"}, {&CPU::INY, "INY"}, {&CPU::JMP, "JMP"}, {&CPU::JSR, "JSR"}, {&CPU::LDA, "LDA"},
+        {&CPU::LDX, "LDX"}, {&CPU::LDY, "LDY"}, {&CPU::LSR, "LSR"}, {&CPU::NOP, "NOP"}, {&CPU::ORA, "ORA"}, {&CPU::PHA, "PHA"},
+        {&CPU::PHP, "PHP"}, {&CPU::PLA, "PLA"}, {&CPU::PLP, "PLP"}, {&CPU::ROL, "ROL"}, {&CPU::ROR, "ROR"}, {&CPU::RTI, "RTI"},
+        {&CPU::RTS, "RTS"}, {&CPU::SBC, "SBC"}, {&CPU::SEC, "SEC"}, {&CPU::SED, "SED"}, {&CPU::SEI, "SEI"}, {&CPU::STA, "STA"},
+        {&CPU::STX, "STX"}, {&CPU::STY, "STY"}, {&CPU::TAX, "TAX"}, {&CPU::TAY, "TAY"}, {&CPU::TSX, "TSX"}, {&CPU::TXA, "TXA"},
+        {&CPU::TXS, "TXS"}, {&CPU::TYA, "TYA"}, {&CPU::AHX, "AHX"}, {&CPU::ALR, "ALR"}, {&CPU::ANC, "ANC"}, {&CPU::ARR, "ARR"},
+        {&CPU::AXS, "AXS"}, {&CPU::DCP, "DCP"}, {&CPU::ISC, "ISC"}, {&CPU::KIL, "KIL"}, {&CPU::LAS, "LAS"}, {&CPU::LAX, "LAX"},
+        {&CPU::RLA, "RLA"}, {&CPU::RRA, "RRA"}, {&CPU::SAX, "SAX"}, {&CPU::SHX, "SHX"}, {&CPU::SHY, "SHY"}, {&CPU::SLO, "SLO"},
+        {&CPU::SRE, "SRE"}, {&CPU::TAS, "TAS"}, {&CPU::XAA, "XAA"}, {&CPU::ASL<true>, "ASL"}, {&CPU::LSR<true>, "LSR"}, {&CPU::ROL<true>, "ROL"},
+        {&CPU::ROR<true>, "ROR"}, {&CPU::LAX<true>, "LAX"}
+    }};
+
+    // Addressing modes in the order they are declared.
+    static constexpr std::array<std::pair<void (CPU::*)(), char const *>, 13> modes = {{
+        {&CPU::ZPX, "ZPX"}, {&CPU::ZPY, "ZPY"}, {&CPU::ABX, "ABX"}, {&CPU::ABY, "ABY"},
+        {&CPU::IDX, "IDX"}, {&CPU::IDY, "IDY"}, {&CPU::IMP, "IMP"}, {&CPU::ACC, "ACC"},
+        {&CPU::IMM, "IMM"}, {&CPU::ZP0, "ZP0"}, {&CPU::ABS, "ABS"}, {&CPU::REL, "REL"},
+        {&CPU::IND, "IND"}
+    }};
+
+    std::map<std::string, profiler::Counter> byMode;
+    std::map<std::string, profiler::Counter> byOp;
+    uint64_t oopsTotal = 0;
+
+    out << "{\"opcodes\": [";
+
+    bool first = true;
+    for (uint16_t i = 0x00; i <= 0xFF; i++) {
+        profiler::Counter const &counter = profile.opcodes[i];
+        if (counter.count == 0) continue;
+
+        char const *mode = "";
+        for (auto const &[addrMode, name] : modes) {
+            if (addrMode == opcodes[i].addrMode) mode = name;
+        }
+
+        char const *mnemonic = "";
+        for (auto const &[op, name] : operations) {
+            if (op == opcodes[i].op) mnemonic = name;
+        }
+
+        byMode[mode].add(counter);
+        byOp[mnemonic].add(counter);
+        oopsTotal += profile.oops[i];
+
+        out << (first ? "" : ", ") << "{\"opcode\": " << i << ", \"op\": \"" << mnemonic << "\"";
+        out << ", \"mode\": \"" << mode << "\", \"count\": " << counter.count;
+        out << ", \"nanoseconds\": " << counter.nanoseconds << ", \"oops\": " << profile.oops[i] << "}";
+        first = false;
+    }
+
+    out << "], \"byModeTotal\": {";
+
+    first = true;
+    for (auto const &[name, counter] : byMode) {
+        out << (first ? "" : ", ");
+        profiler::writeCounter(out, name.c_str(), counter);
+        first = false;
+    }
+
+    out << "}, \"byOpTotal\": {";
+
+    first = true;
+    for (auto const &[name, counter] : byOp) {
+        out << (first ? "" : ", ");
+        profiler::writeCounter(out, name.c_str(), counter);
+        first = false;
+    }
+
+    out << "}, \"oops\": " << oopsTotal;
+    out << ", \"cache\": {\"hits\": " << stats.hits << ", \"misses\": " << stats.misses << "}}";
+}
+#endif // NES_PROFILE
@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPOSITE_X86
+#include <immintrin.h>
+#endif
+
+#include "Composite.h"
+
+using std::uint8_t;
+
+bool composite::scalar(
+    uint8_t const *background,
+    uint8_t const *foreground,
+    uint8_t *output,
+    uint8_t const *paletteRam,
+    uint8_t mask,
+    std::size_t size
+) {
+    bool hit = false;
+
+    for (std::size_t i = 0; i < size; i++) {
+        output[i] = paletteRam[pixel(background[i], foreground[i], hit)] & mask;
+    }
+
+    return hit;
+}
+
+#if defined(COMPOSITE_X86) && defined(__SSE2__)
+bool composite::sse2(
+    uint8_t const *background,
+    uint8_t const *foreground,
+    uint8_t *output,
+    uint8_t const *paletteRam,
+    uint8_t mask,
+    std::size_t size
+) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const ones = _mm_set1_epi8(-1);
+    __m128i const pixels = _mm_set1_epi8(0x03);
+    __m128i const behind = _mm_set1_epi8(0x20);
+    __m128i const sprite0 = _mm_set1_epi8(0x40);
+    __m128i const entry = _mm_set1_epi8(0x1F);
+    __m128i hits = zero;
+
+    // Select the palette RAM entries 16 pixels at a time.
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i b = _mm_loadu_si128((__m128i const *)&background[i]);
+        __m128i f = _mm_loadu_si128((__m128i const *)&foreground[i]);
+
+        __m128i backgroundTransparent = _mm_cmpeq_epi8(_mm_and_si128(b, pixels), zero);
+        __m128i foregroundTransparent = _mm_cmpeq_epi8(_mm_and_si128(f, pixels), zero);
+        __m128i isBehind = _mm_cmpeq_epi8(_mm_and_si128(f, behind), behind);
+
+        // Sprite 0 hit.
+        __m128i both = _mm_andnot_si128(_mm_or_si128(backgroundTransparent, foregroundTransparent), ones);
+        hits = _mm_or_si128(hits, _mm_and_si128(both, f));
+
+        // The background is drawn if the sprite is transparent or behind it.
+        __m128i front = _mm_or_si128(backgroundTransparent, _mm_andnot_si128(isBehind, ones));
+        __m128i useForeground = _mm_andnot_si128(foregroundTransparent, front);
+        __m128i selected = _mm_or_si128(
+            _mm_and_si128(useForeground, _mm_and_si128(f, entry)),
+            _mm_andnot_si128(useForeground, b)
+        );
+
+        _mm_storeu_si128((__m128i *)&output[i], selected);
+    }
+
+    // SSE2 can not look up bytes in a table.
+    for (std::size_t j = 0; j < i; j++) output[j] = paletteRam[output[j]] & mask;
+
+    hits = _mm_cmpeq_epi8(_mm_and_si128(hits, sprite0), sprite0);
+    bool hit = _mm_movemask_epi8(hits) != 0x0000;
+
+    // The rest of the pixels.
+    if (scalar(&background[i], &foreground[i], &output[i], paletteRam, mask, size - i)) hit = true;
+
+    return hit;
+}
+#else
+bool composite::sse2(
+    uint8_t const *background,
+    uint8_t const *foreground,
+    uint8_t *output,
+    uint8_t const *paletteRam,
+    uint8_t mask,
+    std::size_t size
+) {
+    return scalar(background, foreground, output, paletteRam, mask, size);
+}
+#endif
+
+#ifdef COMPOSITE_X86
+__attribute__((target("avx2")))
+bool composite::avx2(
+    uint8_t const *background,
+    uint8_t const *foreground,
+    uint8_t *output,
+    uint8_t const *paletteRam,
+    uint8_t mask,
+    std::size_t size
+) {
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const pixels = _mm256_set1_epi8(0x03);
+    __m256i const behind = _mm256_set1_epi8(0x20);
+    __m256i const sprite0 = _mm256_set1_epi8(0x40);
+    __m256i const entry = _mm256_set1_epi8(0x1F);
+    __m256i const high = _mm256_set1_epi8(0x10);
+    __m256i const masks = _mm256_set1_epi8(mask);
+    __m256i hits = zero;
+
+    // Palette RAM is looked up 16 entries at a time, sprite palettes are in the upper half.
+    __m256i backgroundPalettes = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)&paletteRam[0x00]));
+    __m256i foregroundPalettes = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i const *)&paletteRam[0x10]));
+
+    // Merge 32 pixels at a time.
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i b = _mm256_loadu_si256((__m256i const *)&background[i]);
+        __m256i f = _mm256_loadu_si256((__m256i const *)&foreground[i]);
+
+        __m256i backgroundOpaque = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(b, pixels), zero), _mm256_set1_epi8(-1));
+        __m256i foregroundOpaque = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_and_si256(f, pixels), zero), _mm256_set1_epi8(-1));
+        __m256i isBehind = _mm256_cmpeq_epi8(_mm256_and_si256(f, behind), behind);
+
+        // Sprite 0 hit.
+        hits = _mm256_or_si256(hits, _mm256_and_si256(_mm256_and_si256(backgroundOpaque, foregroundOpaque), f));
+
+        // The background is drawn if the sprite is transparent or behind it.
+        __m256i useForeground = _mm256_andnot_si256(_mm256_and_si256(backgroundOpaque, isBehind), foregroundOpaque);
+        __m256i selected = _mm256_blendv_epi8(b, _mm256_and_si256(f, entry), useForeground);
+
+        // Look up the entry in both halves of palette RAM and pick the right one.
+        __m256i low = _mm256_shuffle_epi8(backgroundPalettes, selected);
+        __m256i upper = _mm256_shuffle_epi8(foregroundPalettes, selected);
+        __m256i isUpper = _mm256_cmpeq_epi8(_mm256_and_si256(selected, high), high);
+        __m256i color = _mm256_and_si256(_mm256_blendv_epi8(low, upper, isUpper), masks);
+
+        _mm256_storeu_si256((__m256i *)&output[i], color);
+    }
+
+    hits = _mm256_cmpeq_epi8(_mm256_and_si256(hits, sprite0), sprite0);
+    bool hit = _mm256_movemask_epi8(hits) != 0x00000000;
+
+    // The rest of the pixels.
+    if (sse2(&background[i], &foreground[i], &output[i], paletteRam, mask, size - i)) hit = true;
+
+    return hit;
+}
+
+composite::Kernel composite::best() {
+    // The PPU might be constructed before the processor features are known.
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) return &avx2;
+    return &sse2;
+}
+#else
+bool composite::avx2(
+    uint8_t const *background,
+    uint8_t const *foreground,
+    uint8_t *output,
+    uint8_t const *paletteRam,
+    uint8_t mask,
+    std::size_t size
+) {
+    return scalar(background, foreground, output, paletteRam, mask, size);
+}
+
+composite::Kernel composite::best() {
+    return &scalar;
+}
+#endif
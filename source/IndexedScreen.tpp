@@ -0,0 +1,20 @@
+#ifndef T_INDEXEDSCREEN
+#define T_INDEXEDSCREEN
+
+#ifndef H_INDEXEDSCREEN
+#error __FILE__ should only be included from IndexedScreen.h.
+#endif // H_INDEXEDSCREEN
+
+#include "IndexedScreen.h"
+
+template <std::size_t W, std::size_t H>
+template <PixelFormat F>
+void IndexedScreen<W, H>::convert(Palette<F> &palette, typename Palette<F>::Pixel *pixels) {
+    uint16_t const *indices = IndexedScreen::front();
+
+    for (std::size_t i = 0; i < W * H; i++) {
+        pixels[i] = palette.lookup(indices[i]);
+    }
+}
+
+#endif // T_INDEXEDSCREEN
@@ -1,6 +1,7 @@
 #include <cstdint>
 
 #include "Mapper.h"
+#include "Bus.h"
 #include "constants.h"
 
 using std::uint16_t;
@@ -12,10 +13,38 @@ uint16_t Mapper::mirrorAddr(uint16_t addr) {
             else return addr & 0x03FF;
         case NametableLayout::VERTICAL:
             return addr & 0x07FF;
+        case NametableLayout::ALTERNATIVE:
         case NametableLayout::FOUR:
             return addr & 0x0FFF;
+        case NametableLayout::SINGLE_LOWER:
+            return addr & 0x03FF;
+        case NametableLayout::SINGLE_UPPER:
+            return (addr & 0x03FF) | 0x0400;
         default:
             // Never reached.
             return 0x00;
     };
+}
+
+uint8_t *Mapper::nametable(uint16_t addr, uint8_t *vram) {
+    return &vram[mirrorAddr(addr & 0x2C00)];
+}
+
+void Mapper::remapPrg() {
+    if (bus) bus->mapCart();
+}
+
+void Mapper::remapChr() {
+    if (bus) bus->mapChr();
+}
+
+void Mapper::remapNametables() {
+    if (bus) bus->mapNametables();
+}
+
+void Mapper::setMirrorMode(NametableLayout mirrorMode) {
+    if (this->mirrorMode == mirrorMode) return;
+
+    this->mirrorMode = mirrorMode;
+    remapNametables();
 }
\ No newline at end of file
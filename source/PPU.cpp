@@ -1,5 +1,8 @@
 #include <cstdint>
 #include <array>
+#include <algorithm>
+#include <bit>
+#include <ostream>
 
 #include "PPU.h"
 
@@ -7,6 +10,10 @@ using std::uint16_t;
 using std::uint8_t;
 
 void PPU::tick() {
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.tick);
+    #endif
+
     if (scanline <= 239) {
         // Visible frame.
         tickVisibleFrame();
@@ -30,6 +37,7 @@ void PPU::tick() {
     if (dot == 341) {
         dot = 0;
         scanline++;
+        if (scanline == 240 && reusing) repeatFrame();
     }
 
     // NOTE: Scanline 312 on PAL/Dendy
@@ -39,6 +47,44 @@ void PPU::tick() {
     // First dot is skipped on even frames.
     if (odd) dot = 1;
     odd = !odd;
+
+    // Only every frameSkip:th frame is output.
+    skippedFrames = outputFrame ? 1 : skippedFrames + 1;
+    outputFrame = skippedFrames >= frameSkip;
+
+    // An output frame repeats the last one if nothing changed since it started.
+    if (!outputFrame) return;
+
+    reusing = frameReuse && !frameChanged && registers() == frameRegisters;
+    frameChanged = false;
+    frameRegisters = registers();
+}
+
+void PPU::run(uint32_t dots) {
+    while (dots > 0) {
+        // Render the rest of a visible scanline at once if the PPU runs past its end.
+        if (lineRendering && scanline <= 239 && dot <= 1 && dots >= 341u - dot) {
+            dots -= 341 - dot;
+            renderLine();
+            continue;
+        }
+
+        // Nothing happens during vblank except setting the vblank flag.
+        if (lineRendering && 240 <= scanline && scanline <= 260 && !(scanline == 241 && dot == 1)) {
+            uint32_t position = scanline * 341 + dot;
+            uint32_t end = position < 241 * 341 + 1 ? 241 * 341 + 1 : 261 * 341;
+            uint32_t idle = std::min(dots, end - position);
+
+            position += idle;
+            scanline = position / 341;
+            dot = position % 341;
+            dots -= idle;
+            continue;
+        }
+
+        tick();
+        dots--;
+    }
 }
 
 void PPU::power() {
@@ -51,6 +97,7 @@ void PPU::power() {
     t.addr = 0x0000;
     odd = false;
     nmi = false;
+    invalidate();
 }
 
 void PPU::reset() {
@@ -61,18 +108,189 @@ void PPU::reset() {
     t.addr = 0x0000;
     odd = false;
     nmi = false;
+    invalidate();
 }
 
 void PPU::insertCart(std::shared_ptr<Mapper> cart) {
     this->cart = cart;
+    mapChr();
+    mapNametables();
+}
+
+void PPU::mapChr() {
+    for (uint8_t bank = 0; bank < 8; bank++) {
+        mapChrBank(bank, cart ? cart->chrBank(bank << 10) : nullptr);
+    }
+}
+
+void PPU::mapChrBank(uint8_t bank, uint8_t const *source) {
+    if (chrBanks[bank] != source) invalidate();
+    chrBanks[bank] = source;
+    tiles[bank] = nullptr;
+
+    if (source == nullptr) return;
+
+    // Decode the bank the first time it is mapped.
+    std::shared_ptr<TileBank> &decoded = tileBanks[source];
+    if (!decoded) {
+        decoded = std::make_shared<TileBank>();
+        for (uint16_t row = 0; row < 0x200; row++) {
+            decodeRow((*decoded)[row], &source[((row & 0x01F8) << 1) | (row & 0x0007)]);
+        }
+    }
+
+    tiles[bank] = decoded.get();
+}
+
+void PPU::mapNametables() {
+    for (uint8_t table = 0; table < 4; table++) mapNametable(table, lookupNametable(table));
+}
+
+void PPU::mapNametable(uint8_t table, uint8_t *memory) {
+    if (nametables[table] != memory) invalidate();
+    nametables[table] = memory;
+}
+
+uint8_t *PPU::lookupNametable(uint8_t table) {
+    return cart ? cart->nametable(0x2000 | (table << 10), vram.data()) : nullptr;
+}
+
+void PPU::follow(PPU const &ppu) {
+    snapshot(ppu);
+
+    // Written CHR memory is decoded again, so the tiles are decoded for this PPU alone.
+    tileBanks.clear();
+    for (uint8_t bank = 0; bank < 8; bank++) mapChrBank(bank, chrBanks[bank]);
+
+    // The screens might not have the frames of the other PPU.
+    frameChanged = true;
+}
+
+void PPU::snapshot(PPU const &ppu) {
+    *this = ppu;
+
+    // The nametables in VRAM have to be the copied ones.
+    for (uint8_t table = 0; table < 4; table++) {
+        uint8_t *memory = ppu.nametables[table];
+        bool inVram = memory >= ppu.vram.data() && memory < ppu.vram.data() + ppu.vram.size();
+        if (inVram) nametables[table] = vram.data() + (memory - ppu.vram.data());
+    }
+}
+
+void PPU::decodeRow(TileRow &row, uint8_t const *pattern) {
+    // The high bits of a row are stored 8 bytes after the low bits.
+    row.low = pattern[0x00];
+    row.high = pattern[0x08];
+
+    // A row decoded again, like after a CHR-RAM write, must not keep the bits of the old pattern.
+    row.flippedLow = 0x00;
+    row.flippedHigh = 0x00;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t low = (row.low >> (7 - i)) & 0x01;
+        uint8_t high = (row.high >> (7 - i)) & 0x01;
+        row.pixels[i] = (high << 1) | low;
+        row.flippedPixels[7 - i] = row.pixels[i];
+        row.flippedLow = row.flippedLow | (low << i);
+        row.flippedHigh = row.flippedHigh | (high << i);
+    }
+}
+
+uint8_t PPU::fetchPattern(uint16_t addr, bool flip) {
+    TileBank const *bank = tiles[(addr >> 10) & 0x07];
+
+    if (bank) {
+        TileRow const &row = (*bank)[((addr & 0x03F0) >> 1) | (addr & 0x0007)];
+        if (addr & 0x0008) return flip ? row.flippedHigh : row.high;
+        return flip ? row.flippedLow : row.low;
+    }
+
+    uint8_t data = read(addr);
+
+    if (flip) {
+        data = (data & 0xF0) >> 4 | (data & 0x0F) << 4;
+        data = (data & 0xCC) >> 2 | (data & 0x33) << 2;
+        data = (data & 0xAA) >> 1 | (data & 0x55) << 1;
+    }
+
+    return data;
 }
 
 void PPU::connectScreen(std::shared_ptr<Screen<256, 240>> screen) {
     this->screen = screen;
+    invalidate();
+}
+
+void PPU::connectScreen(std::shared_ptr<IndexedScreen<256, 240>> screen) {
+    this->indexedScreen = screen;
+    invalidate();
 }
 
-void PPU::setPalette(Palette palette) {
+void PPU::setPalette(Palette<> palette) {
     this->palette = palette;
+    invalidate();
+}
+
+void PPU::setOutput(bool output) {
+    this->output = output;
+
+    // The sprites of the current line might not have been rasterized without output.
+    if (output && spritesSkipped) rasterizeSprites();
+}
+
+bool PPU::reused() const {
+    return reusing;
+}
+
+bool PPU::drawn() {
+    return output && outputFrame && !reusing;
+}
+
+void PPU::invalidate() {
+    frameChanged = true;
+    if (!reusing) return;
+
+    // The lines so far are the same as in the newest frame, the rest of the frame is drawn.
+    reusing = false;
+    if (!output) return;
+
+    for (uint16_t line = 0; line <= scanline; line++) {
+        if (screen) screen->repeatLine(line);
+        if (indexedScreen) indexedScreen->repeatLine(line);
+    }
+
+    // Lines past their last dot are committed and, with the last line, the frame.
+    uint16_t lines = dot > 255 ? scanline + 1 : scanline;
+    if (lines > 0) commit(0, lines - 1);
+    if (spritesSkipped) rasterizeSprites();
+}
+
+bool PPU::inFrame() {
+    return scanline <= 239 || scanline == 261;
+}
+
+uint64_t PPU::registers() {
+    uint64_t registers = (uint64_t)v.addr << 40 | (uint64_t)t.addr << 24;
+    return registers | fineX << 16 | ppumask.reg << 8 | ppuctrl.reg;
+}
+
+void PPU::repeatFrame() {
+    reusing = false;
+    if (!output) return;
+
+    if (screen) screen->repeatFrame();
+    if (indexedScreen) indexedScreen->repeatFrame();
+}
+
+void PPU::commit(uint16_t first, uint16_t last) {
+    if (!drawn()) return;
+
+    for (uint16_t line = first; line <= last; line++) {
+        if (screen) screen->commitLine(line);
+        if (indexedScreen) indexedScreen->commitLine(line);
+    }
+
+    if (last == 239) displayFrame();
 }
 
 uint8_t PPU::registerRead(uint16_t addr) {
@@ -102,6 +320,7 @@ uint8_t PPU::registerRead(uint16_t addr) {
             // When the CPU reads from the PPU memory PPUADDR is increased by 1 or 32 depending on 
             // increment mode.
             v.addr += 0x01 + 0x1F * ppuctrl.incrementMode;
+            if (inFrame()) invalidate();
 
             return data;
         }
@@ -112,12 +331,19 @@ uint8_t PPU::registerRead(uint16_t addr) {
 }
 
 void PPU::registerWrite(uint16_t addr, uint8_t data) {
+    uint64_t before = registers();
+
     switch (addr) {
-        case 0x2000:
+        case 0x2000: {
             // PPUCTRL
+            uint8_t spriteHeight = ppuctrl.spriteHeight;
             ppuctrl.reg = data;
             t.nametable = ppuctrl.nametable;
+
+            // Sprites cover other lines with another height.
+            if (ppuctrl.spriteHeight != spriteHeight) spriteLinesValid = false;
             break;
+        }
         case 0x2001:
             // PPUMASK
             ppumask.reg = data;
@@ -133,8 +359,7 @@ void PPU::registerWrite(uint16_t addr, uint8_t data) {
             break;
         case 0x2004:
             // OAMDATA
-            ((uint8_t*)primaryOam.data())[oamaddr] = data;
-            oamaddr++;
+            writeOam(data);
             break;
         case 0x2005:
             // PPUSCROLL
@@ -168,13 +393,62 @@ void PPU::registerWrite(uint16_t addr, uint8_t data) {
             v.addr += 0x01 + 0x1F * ppuctrl.incrementMode;
             break;
     }
+
+    // Registers changed outside of the frame are compared when the next frame starts.
+    if (inFrame() && registers() != before) invalidate();
 }
 
 void PPU::dmaWrite(uint8_t data) {
-    ((uint8_t*)primaryOam.data())[oamaddr] = data;
+    writeOam(data);
+}
+
+void PPU::writeOam(uint8_t data) {
+    // A sprite with a new y coordinate covers other lines.
+    bool moved = spriteLinesValid && (oamaddr & 0x03) == 0x00;
+
+    uint8_t &byte = ((uint8_t*)primaryOam.data())[oamaddr];
+    if (byte != data) invalidate();
+
+    if (moved) indexSprite(oamaddr >> 2, false);
+    byte = data;
+    if (moved) indexSprite(oamaddr >> 2, true);
+
     oamaddr++;
 }
 
+uint8_t PPU::status() const {
+    return ppustatus.status & 0xE0;
+}
+
+uint32_t PPU::idleDots(bool status) {
+    // The NMI is triggered when vblank starts.
+    uint32_t dots = dotsUntil(241, 1);
+    if (!status) return dots;
+
+    // The flags are cleared on the pre-render scanline.
+    dots = std::min(dots, dotsUntil(261, 1));
+
+    // Sprite 0 hit and sprite overflow might be set at any dot of the visible frame.
+    if (!ppustatus.S || !ppustatus.O) {
+        if (scanline <= 239) return 0;
+        dots = std::min(dots, dotsUntil(0, 0));
+    }
+
+    return dots;
+}
+
+uint32_t PPU::dotsUntil(uint16_t toScanline, uint16_t toDot) {
+    uint32_t position = scanline * 341 + dot;
+    uint32_t target = toScanline * 341 + toDot;
+    if (target >= position) return target - position;
+
+    // The first dot of the next frame is skipped on odd frames.
+    uint32_t start = odd ? 1 : 0;
+    if (target < start) target = start;
+
+    return 262 * 341 - position + target - start;
+}
+
 bool PPU::fblank() {
     return !ppumask.enableBackground && !ppumask.enableSprite;
 }
@@ -191,11 +465,7 @@ uint8_t PPU::read(uint16_t addr) {
             return 0x00;
         }
     } else if (addr <= 0x2FFF) {
-        if (cart) {
-            return vram[cart->mirrorAddr(addr)];
-        } else {
-            return 0x00;
-        }
+        return readNametable(addr);
     } else if (addr <= 0x3EFF) {
         // Unmapped.
         return 0x00;
@@ -215,9 +485,21 @@ void PPU::write(uint16_t addr, uint8_t data) {
     addr = addr & 0x3FFF; // PPU addresses are 14 bits.
 
     if (addr <= 0x1FFF) {
+        // Writing the same byte changes nothing.
+        uint8_t const *source = chrBanks[addr >> 10];
+        if (!source || source[addr & 0x03FF] != data) invalidate();
+
         if (cart) cart->ppuWrite(addr, data);
+
+        // Decode the written row of CHR-RAM again.
+        if (tiles[addr >> 10]) {
+            uint16_t offset = addr & 0x03F7;
+            decodeRow((*tiles[addr >> 10])[((offset & 0x03F0) >> 1) | (offset & 0x0007)], &source[offset]);
+        }
     } else if (addr <= 0x2FFF) {
-        if (cart) vram[cart->mirrorAddr(addr)] = data;
+        uint8_t *nametable = nametables[(addr >> 10) & 0x03];
+        if (nametable && nametable[addr & 0x03FF] != data) invalidate();
+        if (nametable) nametable[addr & 0x03FF] = data;
     } else if (addr <= 0x3EFF) {
         // Unmapped
     } else if (addr <= 0x3FFF) {
@@ -226,10 +508,16 @@ void PPU::write(uint16_t addr, uint8_t data) {
         // Every 4:th byte is mapped to 0x00 of the palette RAM.
         if ((addr & 0x000F) == 0x0000) addr = 0x0000; 
 
+        if (paletteRam[addr] != data) invalidate();
         paletteRam[addr] = data;
     }
 }
 
+uint8_t PPU::readNametable(uint16_t addr) {
+    uint8_t const *nametable = nametables[(addr >> 10) & 0x03];
+    return nametable ? nametable[addr & 0x03FF] : 0x00;
+}
+
 void PPU::Loopy::incrementX() {
     coarseX++;
     // If wrapped around switch horizontal nametable.
@@ -258,12 +546,9 @@ uint16_t PPU::attrAddr() {
 }
 
 void PPU::tickVisibleFrame() {
-    // Display a finished frame on the screen.
-    if (scanline == 239 && dot == 255 && screen) {
-        std::array<uint8_t, 3> color = screen->get(0, 0);
-        screen->swap();
-        screen->put(0, 0, color);
-    }
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.tickVisibleFrame);
+    #endif
 
     if (fblank()) {
         drawDot();
@@ -280,6 +565,92 @@ void PPU::tickVisibleFrame() {
     fetchForeground();
 }
 
+void PPU::renderLine() {
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.renderLine);
+    #endif
+
+    uint16_t first = dot;
+    bool blank = fblank();
+
+    // Frames which are not output only need the pixels of lines where sprite 0 might be hit.
+    bool pixels = drawn() || hasSprite0Current;
+
+    // The first dot only draws and clears secondary OAM.
+    if (dot == 0) {
+        if (!blank) updateShifters();
+
+        if (pixels) {
+            lineBackground[0] = backgroundPixel();
+            lineForeground[0] = foregroundPixel();
+        }
+
+        if (!blank) fetchForeground();
+        dot++;
+    }
+
+    for (; dot <= 256; dot++) {
+        if (!blank) {
+            if (dot >= 2) shiftBackground();
+
+            fetchTile();
+            if (dot == 256) v.incrementY();
+        }
+
+        // Dot 256 is outside the screen but sprite 0 might still be hit.
+        if (dot <= 255) {
+            if (pixels) {
+                lineBackground[dot] = backgroundPixel();
+                lineForeground[dot] = foregroundPixel();
+            }
+        } else {
+            drawDot();
+        }
+
+        if (blank) continue;
+        if ((dot & 0x0001) == 0x0000) evaluateSprites();
+    }
+
+    // Composite the pixels of the line.
+    if (pixels) {
+        uint8_t mask = ppumask.grayscale ? 0x30 : 0xFF;
+        bool hit = compositeLine(
+            &lineBackground[first],
+            &lineForeground[first],
+            &lineOutput[first],
+            paletteRam.data(),
+            mask,
+            256 - first
+        );
+
+        // Set sprite 0 hit flag.
+        if (hit && hasSprite0Current) ppustatus.S = true;
+    }
+
+    for (uint16_t x = first; drawn() && x <= 255; x++) {
+        putDot(x, lineOutput[x]);
+    }
+
+    // The rest of the dots are outside the screen but sprite 0 might still be hit.
+    for (; dot <= 340; dot++) {
+        if (blank) continue;
+
+        updateShifters();
+        fetchBackground();
+        if (hasSprite0Current && !ppustatus.S) drawDot();
+        fetchForeground();
+    }
+
+    dot = 0;
+    scanline++;
+    if (scanline == 240 && reusing) repeatFrame();
+}
+
+void PPU::displayFrame() {
+    if (screen) screen->commitFrame();
+    if (indexedScreen) indexedScreen->commitFrame();
+}
+
 void PPU::tickPreRender() {
     if (fblank()) return;
 
@@ -290,6 +661,10 @@ void PPU::tickPreRender() {
         ppustatus.V = false;
         ppustatus.S = false;
         ppustatus.O = false;
+
+        // No sprites are fetched for the first line, the sprites of the last line are shifted out.
+        spriteLine.fill(0x00);
+        spritesSkipped = false;
     }
 
     if (280 <= dot && dot <= 304) {
@@ -301,79 +676,64 @@ void PPU::tickPreRender() {
 }
 
 void PPU::drawDot() {
-    uint8_t background = 0x00;
-    uint8_t foreground = 0x00;
-    uint8_t output = 0x00;
-    bool isForegroundSprite0 = false;
-    bool priority;
-
-    bool isBackgroundEnabled = ppumask.enableBackground && (dot >= 8 || ppumask.backgroundLeft);
-    bool isForegroundEnabled = ppumask.enableSprite && (dot >= 8 || ppumask.spriteLeft);
-
-    // Get background pixel value.
-    if (isBackgroundEnabled) {
-        uint16_t selected = 0x8000 >> fineX;
-        uint8_t backgroundLow = (selected & shifterPatternLow) != 0x0000;
-        uint8_t backgroundHigh = (selected & shifterPatternHigh) != 0x0000;
-        uint8_t backgroundPalLow = (selected & shifterPalLow) != 0x0000;
-        uint8_t backgroundPalHigh = (selected & shifterPalHigh) != 0x0000;
-        uint8_t backgroundPal = (backgroundPalHigh << 1) | backgroundPalLow;
-        
-        background = (backgroundPal << 2) | (backgroundHigh << 1) | backgroundLow;
-
-        if ((background & 0x03) == 0x00) background = 0x00;
-    }
-
-    // Get foreground pixel value.
-    if (isForegroundEnabled) {
-        uint8_t foregroundLow = 0x00;
-        uint8_t foregroundHigh = 0x00;
-
-        for (size_t i = 0; i < 8; i++) {
-            if (mpbm[i].x > 0) continue;
-
-            foregroundLow = (mpbm[i].low & 0x80) != 0x00;
-            foregroundHigh = (mpbm[i].high & 0x80) != 0x00;
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.drawDot);
+    #endif
 
-            foreground = (foregroundHigh << 1) | foregroundLow;
+    // Only sprite 0 hits have to be found in frames which are not output.
+    if (!drawn() && !hasSprite0Current) return;
 
-            if (foreground != 0x00) {
-                foreground = 0x10 | (mpbm[i].pal << 2) | foreground;
-                isForegroundSprite0 = i == 0;
-                priority = mpbm[i].prio;
-                break;
-            }; 
-        }
-    }
-    
     // Get which palette index to output.
-    if ((background & 0x03) != 0x00 && (foreground & 0x03) != 0x00) {
-        // Set sprite 0 hit flag.
-        ppustatus.S = ppustatus.S || (hasSprite0Current && isForegroundSprite0);
+    bool hit = false;
+    uint8_t output = paletteRam[composite::pixel(backgroundPixel(), foregroundPixel(), hit)];
 
-        if (priority) {
-            output = paletteRam[background];
-        } else {
-            output = paletteRam[foreground];
-        }
-    } else if ((background & 0x03) != 0x00) {
-        output = paletteRam[background];
-    } else if ((foreground & 0x03) != 0x00) {
-        output = paletteRam[foreground];
-    } else {
-        output = paletteRam[0x00];
-    }
+    // Set sprite 0 hit flag.
+    if (hit && hasSprite0Current) ppustatus.S = true;
+    if (!drawn()) return;
     
     // Grayscale forces output color to be white/gray by AND:ing with 0x30.
     if (ppumask.grayscale) output = output & 0x30;
 
     // Output dot to screen.
-    uint8_t r = palette.getR(output);
-    uint8_t g = palette.getG(output);
-    uint8_t b = palette.getB(output);
+    putDot(dot, output);
+}
+
+void PPU::putDot(uint16_t x, uint8_t color) {
+    if (scanline > 239 || x > 255) return;
+
+    if (screen) screen->line(scanline)[x] = palette.get(color);
+
+    // The emphasis bits of PPUMASK are moved above the 6 bit color.
+    if (indexedScreen) indexedScreen->line(scanline)[x] = ((ppumask.reg & 0xE0) << 1) | (color & 0x3F);
 
+    // Commit the line when its last dot is drawn and the frame with its last line.
+    if (x != 255 || deferCommits) return;
 
-    if (screen) screen->put(dot, scanline, r, g, b);
+    if (screen) screen->commitLine(scanline);
+    if (indexedScreen) indexedScreen->commitLine(scanline);
+    if (scanline == 239) displayFrame();
+}
+
+uint8_t PPU::backgroundPixel() {
+    if (!ppumask.enableBackground || (dot < 8 && !ppumask.backgroundLeft)) return 0x00;
+
+    uint16_t selected = 0x8000 >> fineX;
+    uint8_t backgroundLow = (selected & shifterPatternLow) != 0x0000;
+    uint8_t backgroundHigh = (selected & shifterPatternHigh) != 0x0000;
+    uint8_t backgroundPalLow = (selected & shifterPalLow) != 0x0000;
+    uint8_t backgroundPalHigh = (selected & shifterPalHigh) != 0x0000;
+    uint8_t backgroundPal = (backgroundPalHigh << 1) | backgroundPalLow;
+
+    if ((backgroundHigh | backgroundLow) == 0x00) return 0x00;
+
+    return (backgroundPal << 2) | (backgroundHigh << 1) | backgroundLow;
+}
+
+uint8_t PPU::foregroundPixel() {
+    if (!ppumask.enableSprite || (dot < 8 && !ppumask.spriteLeft)) return 0x00;
+
+    // Sprites are shifted out from the second dot, so the first two dots show the first column.
+    return spriteLine[dot == 0 ? 0 : std::min<uint16_t>(dot - 1, 255)];
 }
 
 void PPU::fetchBackground() {
@@ -392,11 +752,11 @@ void PPU::fetchBackground() {
         switch (dot & 0x0007) {
             case 0x0001:
                 // Unused fetch.
-                nextTile = read(tileAddr());
+                nextTile = readNametable(tileAddr());
             return;
             case 0x0003:
                 // Ignored fetch.
-                read(tileAddr());
+                readNametable(tileAddr());
             return;
                 default:
             return;
@@ -404,6 +764,12 @@ void PPU::fetchBackground() {
     }
 
     // Dot 1-256 and 321-236
+    fetchTile();
+
+    if (dot == 256) v.incrementY();
+}
+
+void PPU::fetchTile() {
     switch (dot & 0x0007) {
         case 0x0000:
             v.incrementX();
@@ -411,24 +777,24 @@ void PPU::fetchBackground() {
         case 0x0001:
             loadShifters();
 
-            nextTile = read(tileAddr());
+            nextTile = readNametable(tileAddr());
             break;
         case 0x0003:
-            nextAttr = read(attrAddr());
+            nextAttr = readNametable(attrAddr());
 
             if (v.coarseY & 0x02) nextAttr = nextAttr >> 4;
             if (v.coarseX & 0x02) nextAttr = nextAttr >> 2;
             nextAttr = nextAttr & 0x03;
             break;
         case 0x0005:
-            nextPatternLow = read(
+            nextPatternLow = fetchPattern(
                 (ppuctrl.backgroundTable << 12) |
                 (nextTile << 4) |
                 v.fineY
             );
             break;
         case 0x0007:
-            nextPatternHigh = read(
+            nextPatternHigh = fetchPattern(
                 (ppuctrl.backgroundTable << 12) |
                 (nextTile << 4) |
                 (v.fineY + 8)
@@ -437,60 +803,20 @@ void PPU::fetchBackground() {
         default:
             break;
     }
-
-    if (dot == 256) v.incrementY();
 }
 
 void PPU::fetchForeground() {
+    #ifdef NES_PROFILE
+    profiler::Timer timer(profile.fetchForeground);
+    #endif
+
     if (dot <= 64) {
-        if ((dot & 0x0001) == 0x0000) ((uint8_t*)secondaryOam.data())[(dot - 2) >> 1] = 0xFF;
+        if ((dot & 0x0001) == 0x0000) evaluateSprites();
     } else if (dot <= 256) {
         // Read on odd cycles.
         if (dot & 0x0001) return;
 
-        // All sprites searched or all sprites found and overflow set.
-        // NOTE: Some behavior where primary and secondary pointers should increment has been left out by this.
-        if (primaryPtr >= 0x0100 || ppustatus.O) return; 
-
-        // If current sprite was in range copy it to secondary OAM.
-        if ((secondaryPtr & 0x03) != 0x00) {
-            ((uint8_t*)secondaryOam.data())[secondaryPtr] = ((uint8_t*)primaryOam.data())[primaryPtr];
-
-            // Move to next field in both OAMs.
-            secondaryPtr += 0x01;
-            primaryPtr += 0x01;
-            return;
-        }
-
-        // Check if current primary OAM pointer is in range if interpreted as a y coordinate.
-        uint8_t y = ((uint8_t*)primaryOam.data())[primaryPtr];
-        bool inRange = y <= scanline && scanline <= y + 0x07 + 0x08 * ppuctrl.spriteHeight;
-
-        // If all sprites has been found check for sprite overflow.
-        if (secondaryPtr >= 0x20) {
-            ppustatus.O = inRange;
-
-            // Sprite overflow bug. Increment both entry pointer and field pointer.
-            primaryPtr += 0x05;
-            return;
-        }
-        
-        // Copy y coordinate of current primary OAM sprite into secondary OAM.
-        ((uint8_t*)secondaryOam.data())[secondaryPtr] = ((uint8_t*)primaryOam.data())[primaryPtr];
-
-        // If the y coordinate is in range copy the other fields to secondary OAM.
-        if (inRange) {
-            // If it is the first entry in the primary OAM it is sprite 0.
-            if (primaryPtr == 0x00) hasSprite0Next = true;
-
-            // Move to next field in both OAMs.
-            secondaryPtr += 0x01;
-            primaryPtr += 0x01;
-            return;
-        } 
-
-        // Move to next primary OAM entry.
-        primaryPtr += 0x04;
+        evaluateSprites();
         return;
     } else if (dot <= 320) {
         // NOTE: Skips some reads of the secondary OAM.
@@ -509,28 +835,15 @@ void PPU::fetchForeground() {
                 return;
             case 0x0005: {
                 uint16_t addr = spriteAddr(secondaryOam[entry]);
-                uint8_t low = read(addr);
-
-                if (secondaryOam[entry].attr.flipH) {
-                    low = (low & 0xF0) >> 4 | (low & 0x0F) << 4;
-                    low = (low & 0xCC) >> 2 | (low & 0x33) << 2;
-                    low = (low & 0xAA) >> 1 | (low & 0x55) << 1;
-                }
-
-                mpbm[entry].low = low;
+                mpbm[entry].low = fetchPattern(addr, secondaryOam[entry].attr.flipH);
                 return;
             }
             case 0x0007: {
                 uint16_t addr = spriteAddr(secondaryOam[entry]);
-                uint8_t high = read(addr + 0x0008);
+                mpbm[entry].high = fetchPattern(addr + 0x0008, secondaryOam[entry].attr.flipH);
 
-                if (secondaryOam[entry].attr.flipH) {
-                    high = (high & 0xF0) >> 4 | (high & 0x0F) << 4;
-                    high = (high & 0xCC) >> 2 | (high & 0x33) << 2;
-                    high = (high & 0xAA) >> 1 | (high & 0x55) << 1;
-                }
-
-                mpbm[entry].high = high;
+                // All sprites of the next line have been fetched.
+                if (entry == 7) rasterizeSprites();
                 return;
             }
         }
@@ -552,6 +865,130 @@ void PPU::fetchForeground() {
     if (dot == 254) hasSprite0Current = false;
 }
 
+void PPU::evaluateSprites() {
+    if (dot == 0) return;
+
+    if (spriteIndex) {
+        if (dot == 66) selectSprites();
+        if (dot == overflowDot) ppustatus.O = true;
+        return;
+    }
+
+    // Secondary OAM is cleared during the first 64 dots and sprites are evaluated on the rest.
+    if (dot <= 64) {
+        ((uint8_t*)secondaryOam.data())[(dot - 2) >> 1] = 0xFF;
+    } else {
+        evaluateSprite();
+    }
+}
+
+void PPU::evaluateSprite() {
+    // All sprites searched or all sprites found and overflow set.
+    // NOTE: Some behavior where primary and secondary pointers should increment has been left out by this.
+    if (primaryPtr >= 0x0100 || ppustatus.O) return; 
+
+    // If current sprite was in range copy it to secondary OAM.
+    if ((secondaryPtr & 0x03) != 0x00) {
+        ((uint8_t*)secondaryOam.data())[secondaryPtr] = ((uint8_t*)primaryOam.data())[primaryPtr];
+
+        // Move to next field in both OAMs.
+        secondaryPtr += 0x01;
+        primaryPtr += 0x01;
+        return;
+    }
+
+    // Check if current primary OAM pointer is in range if interpreted as a y coordinate.
+    uint8_t y = ((uint8_t*)primaryOam.data())[primaryPtr];
+    bool inRange = y <= scanline && scanline <= y + 0x07 + 0x08 * ppuctrl.spriteHeight;
+
+    // If all sprites has been found check for sprite overflow.
+    if (secondaryPtr >= 0x20) {
+        ppustatus.O = inRange;
+
+        // Sprite overflow bug. Increment both entry pointer and field pointer.
+        primaryPtr += 0x05;
+        return;
+    }
+    
+    // Copy y coordinate of current primary OAM sprite into secondary OAM.
+    ((uint8_t*)secondaryOam.data())[secondaryPtr] = ((uint8_t*)primaryOam.data())[primaryPtr];
+
+    // If the y coordinate is in range copy the other fields to secondary OAM.
+    if (inRange) {
+        // If it is the first entry in the primary OAM it is sprite 0.
+        if (primaryPtr == 0x00) hasSprite0Next = true;
+
+        // Move to next field in both OAMs.
+        secondaryPtr += 0x01;
+        primaryPtr += 0x01;
+        return;
+    } 
+
+    // Move to next primary OAM entry.
+    primaryPtr += 0x04;
+}
+
+void PPU::indexSprite(uint8_t sprite, bool covers) {
+    uint16_t y = primaryOam[sprite].y;
+    uint16_t end = std::min<uint16_t>(y + 0x08 + 0x08 * ppuctrl.spriteHeight, 240);
+    uint64_t bit = 1ull << sprite;
+
+    for (uint16_t line = y; line < end; line++) {
+        if (covers) {
+            spriteLines[line] |= bit;
+        } else {
+            spriteLines[line] &= ~bit;
+        }
+    }
+}
+
+void PPU::buildSpriteIndex() {
+    spriteLines.fill(0x0000000000000000);
+    for (uint8_t sprite = 0; sprite < 64; sprite++) indexSprite(sprite, true);
+    spriteLinesValid = true;
+}
+
+void PPU::selectSprites() {
+    if (!spriteLinesValid) buildSpriteIndex();
+
+    uint64_t line = scanline <= 239 ? spriteLines[scanline] : 0x0000000000000000;
+    uint64_t sprites = line;
+    secondaryOam.fill({0xFF, 0xFF, {.data = 0xFF}, 0xFF});
+    hasSprite0Next = line & 0x01;
+    overflowDot = 0x0000;
+
+    // The first 8 sprites covering the line in OAM order.
+    uint8_t found = 0;
+    uint8_t sprite = 0;
+
+    for (; sprites != 0 && found < 8; sprites &= sprites - 1) {
+        sprite = std::countr_zero(sprites);
+        secondaryOam[found++] = primaryOam[sprite];
+    }
+
+    if (found < 8) {
+        // The y coordinate of the last sprite out of range is left in the first free entry.
+        if (!(line >> 63)) secondaryOam[found].y = primaryOam[63].y;
+        return;
+    }
+
+    // Evaluation checks one sprite per step and takes 3 more steps to copy a sprite in range. 
+    // After 8 sprites are found the rest are checked for overflow, but the byte checked moves one 
+    // further into OAM each time a sprite is not in range.
+    uint16_t steps = sprite + 1 + 3 * 8;
+    uint16_t ptr = (sprite + 1) << 2;
+
+    for (; ptr < 0x0100; ptr += 0x05) {
+        steps++;
+
+        uint8_t y = ((uint8_t*)primaryOam.data())[ptr];
+        if (y <= scanline && scanline <= y + 0x07 + 0x08 * ppuctrl.spriteHeight) break;
+    }
+
+    // Evaluation steps happen every other dot from dot 66 to 256.
+    if (ptr < 0x0100 && steps <= 96) overflowDot = 64 + 2 * steps;
+}
+
 uint16_t PPU::spriteAddr(OAM sprite) {
     uint16_t addr = 0x0000;
     uint8_t relativeY = scanline - sprite.y;
@@ -586,22 +1023,39 @@ void PPU::updateShifters() {
     if (258 <= dot && dot <= 320) return;
 
     // Background shifters.
-    if (dot <= 337) {
-        shifterPatternLow = shifterPatternLow << 1;
-        shifterPatternHigh = shifterPatternHigh << 1;
-        shifterPalLow = shifterPalLow << 1;
-        shifterPalHigh = shifterPalHigh << 1;
-    }
-
-    // Foreground shifters.
-    if (dot <= 257) {
-        for (size_t i = 0; i < mpbm.size(); i++) {
-            if (mpbm[i].x > 0) {
-                mpbm[i].x--;
-            } else {
-                mpbm[i].high = mpbm[i].high << 1;
-                mpbm[i].low = mpbm[i].low << 1;
-            }
+    if (dot <= 337) shiftBackground();
+}
+
+void PPU::shiftBackground() {
+    shifterPatternLow = shifterPatternLow << 1;
+    shifterPatternHigh = shifterPatternHigh << 1;
+    shifterPalLow = shifterPalLow << 1;
+    shifterPalHigh = shifterPalHigh << 1;
+}
+
+void PPU::rasterizeSprites() {
+    spriteLine.fill(0x00);
+
+    // Frames which are not output only need the sprites of lines where sprite 0 might be hit.
+    spritesSkipped = !drawn() && !hasSprite0Next;
+    if (spritesSkipped) return;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t attr = 0x10 | (mpbm[i].pal << 2);
+        if (mpbm[i].prio) attr |= 0x20;
+        if (i == 0) attr |= 0x40;
+
+        // Columns past the end of the line are never drawn.
+        uint16_t end = std::min<uint16_t>(mpbm[i].x + 8, 256);
+
+        for (uint16_t x = mpbm[i].x; x < end; x++) {
+            uint8_t shift = 7 - (x - mpbm[i].x);
+            uint8_t pixel = (((mpbm[i].high >> shift) & 0x01) << 1) | ((mpbm[i].low >> shift) & 0x01);
+
+            // Sprites earlier in the MPBM are drawn in front.
+            if (pixel == 0x00 || spriteLine[x] != 0x00) continue;
+
+            spriteLine[x] = attr | pixel;
         }
     }
 }
@@ -616,4 +1070,20 @@ void PPU::loadShifters() {
     if (nextAttr & 0x02) {
         shifterPalHigh = shifterPalHigh | 0x00FF;
     }
-}
\ No newline at end of file
+}
+
+#ifdef NES_PROFILE
+void PPU::dumpProfile(std::ostream &out) {
+    out << "{";
+    profiler::writeCounter(out, "tick", profile.tick);
+    out << ", ";
+    profiler::writeCounter(out, "tickVisibleFrame", profile.tickVisibleFrame);
+    out << ", ";
+    profiler::writeCounter(out, "fetchForeground", profile.fetchForeground);
+    out << ", ";
+    profiler::writeCounter(out, "drawDot", profile.drawDot);
+    out << ", ";
+    profiler::writeCounter(out, "renderLine", profile.renderLine);
+    out << "}";
+}
+#endif // NES_PROFILE
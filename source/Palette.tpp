@@ -0,0 +1,111 @@
+#ifndef T_PALETTE
+#define T_PALETTE
+
+#ifndef H_PALETTE
+#error __FILE__ should only be included from Palette.h.
+#endif // H_PALETTE
+
+#include "Palette.h"
+
+template <PixelFormat F>
+Palette<F>::Palette() {
+    build(palette::DEFAULT.data(), palette::DEFAULT.size());
+}
+
+template <PixelFormat F>
+Palette<F>::Palette(std::vector<uint8_t> data) {
+    if (data.size() == 0) {
+        build(palette::DEFAULT.data(), palette::DEFAULT.size());
+    } else {
+        build(data.data(), data.size());
+    }
+}
+
+template <PixelFormat F>
+void Palette<F>::build(uint8_t const *data, std::size_t size) {
+    for (std::size_t i = 0; i < table.size(); i++) {
+        // Entries are ordered by emphasis and then color.
+        std::size_t offset = (i & 0x3F) * 3 + (i >> 6) * 192;
+
+        table[i] = pack(
+            data[offset % size],
+            data[(offset + 1) % size],
+            data[(offset + 2) % size]
+        );
+    }
+}
+
+template <PixelFormat F>
+inline typename Palette<F>::Pixel Palette<F>::get(uint16_t entry) {
+    return table[(emphasis << 6) | (entry & 0x3F)];
+}
+
+template <PixelFormat F>
+inline typename Palette<F>::Pixel Palette<F>::lookup(uint16_t index) {
+    return table[index & 0x01FF];
+}
+
+template <PixelFormat F>
+inline uint8_t Palette<F>::getR(uint16_t entry) {
+    return unpack(get(entry))[0];
+}
+
+template <PixelFormat F>
+inline uint8_t Palette<F>::getG(uint16_t entry) {
+    return unpack(get(entry))[1];
+}
+
+template <PixelFormat F>
+inline uint8_t Palette<F>::getB(uint16_t entry) {
+    return unpack(get(entry))[2];
+}
+
+template <PixelFormat F>
+void Palette<F>::setEmphasis(uint16_t emphasis) {
+    this->emphasis = emphasis & 0x07;
+}
+
+template <PixelFormat F>
+void Palette<F>::setEmphasis(bool r, bool g, bool b) {
+    uint16_t emphasis = (b << 2) | (g << 1) | r;
+    this->emphasis = emphasis;
+}
+
+template <PixelFormat F>
+constexpr typename Palette<F>::Pixel Palette<F>::pack(uint8_t r, uint8_t g, uint8_t b) {
+    switch (F) {
+        case PixelFormat::RGBA8888:
+            return ((uint32_t)r << 24) | (g << 16) | (b << 8) | 0xFF;
+        case PixelFormat::BGRA8888:
+            return ((uint32_t)b << 24) | (g << 16) | (r << 8) | 0xFF;
+        case PixelFormat::XRGB8888:
+            return (r << 16) | (g << 8) | b;
+        case PixelFormat::RGB565:
+            return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+
+    return 0;
+}
+
+template <PixelFormat F>
+constexpr std::array<uint8_t, 3> Palette<F>::unpack(Pixel pixel) {
+    switch (F) {
+        case PixelFormat::RGBA8888:
+            return {(uint8_t)(pixel >> 24), (uint8_t)(pixel >> 16), (uint8_t)(pixel >> 8)};
+        case PixelFormat::BGRA8888:
+            return {(uint8_t)(pixel >> 8), (uint8_t)(pixel >> 16), (uint8_t)(pixel >> 24)};
+        case PixelFormat::XRGB8888:
+            return {(uint8_t)(pixel >> 16), (uint8_t)(pixel >> 8), (uint8_t)pixel};
+        case PixelFormat::RGB565: {
+            // Repeat the high bits in the low bits to reach full intensity.
+            uint8_t r = (pixel >> 11) & 0x1F;
+            uint8_t g = (pixel >> 5) & 0x3F;
+            uint8_t b = pixel & 0x1F;
+            return {(uint8_t)((r << 3) | (r >> 2)), (uint8_t)((g << 2) | (g >> 4)), (uint8_t)((b << 3) | (b >> 2))};
+        }
+    }
+
+    return {0x00, 0x00, 0x00};
+}
+
+#endif // T_PALETTE
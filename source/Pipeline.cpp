@@ -0,0 +1,245 @@
+#include <cstdint>
+#include <vector>
+#include <mutex>
+
+#include "Pipeline.h"
+
+using std::uint64_t;
+using std::uint16_t;
+using std::uint8_t;
+
+Pipeline::~Pipeline() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+
+        changed.notify_all();
+        thread.join();
+    }
+
+    setWorkers(0);
+}
+
+void Pipeline::start(PPU const &ppu, uint64_t clock) {
+    // Everything recorded so far is rendered before the state is taken over.
+    stop(clock, ppu.status());
+    if (!thread.joinable()) thread = std::thread(&Pipeline::render, this);
+
+    // The renderer is idle until the next frame is submitted.
+    renderer.follow(ppu);
+    renderer.setOutput(true);
+    this->clock = clock;
+    divergence = false;
+    running = true;
+}
+
+void Pipeline::stop(uint64_t clock, uint8_t status) {
+    if (!running) return;
+
+    submit(clock, status);
+    wait();
+    running = false;
+}
+
+void Pipeline::record(uint64_t clock, Kind kind, uint16_t addr, uint8_t data, uint8_t *memory) {
+    log.push_back({clock, kind, addr, data, memory});
+}
+
+void Pipeline::submit(uint64_t clock, uint8_t status) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // Let the renderer fall at most one frame behind.
+    changed.wait(lock, [this] { return frames.size() < 2; });
+
+    std::size_t size = log.size();
+    frames.push_back({std::move(log), clock, status});
+    log.clear();
+    log.reserve(size);
+
+    lock.unlock();
+    changed.notify_all();
+}
+
+bool Pipeline::diverged() {
+    return divergence;
+}
+
+uint8_t *Pipeline::lookupNametable(uint8_t table) {
+    // Only reads the cartridge and the address of the VRAM, which the renderer never changes.
+    return renderer.lookupNametable(table);
+}
+
+void Pipeline::setWorkers(uint8_t count) {
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(bandMutex);
+        quitWorkers = true;
+    }
+
+    bandChanged.notify_all();
+    for (std::thread &worker : workers) worker.join();
+
+    workers.clear();
+    quitWorkers = false;
+    bands.resize(count);
+
+    for (uint8_t i = 0; i < count; i++) workers.emplace_back(&Pipeline::work, this);
+}
+
+void Pipeline::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return frames.empty(); });
+}
+
+void Pipeline::render() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        changed.wait(lock, [this] { return quit || !frames.empty(); });
+        if (frames.empty()) return;
+
+        // The frame stays queued while it is rendered so that the CPU can tell how far behind it is.
+        lock.unlock();
+        replay(frames.front());
+        lock.lock();
+
+        frames.pop_front();
+        changed.notify_all();
+    }
+}
+
+void Pipeline::replay(Frame const &frame) {
+    if (banded(frame)) {
+        replayBands(frame);
+    } else {
+        replay(renderer, frame.log, 0, clock, frame.end);
+    }
+
+    if (renderer.status() != frame.status) divergence = true;
+}
+
+std::size_t Pipeline::replay(PPU &ppu, std::vector<Access> const &log, std::size_t first, uint64_t &clock, uint64_t end) {
+    std::size_t next = first;
+
+    for (; next < log.size() && log[next].clock <= end; next++) {
+        Access const &access = log[next];
+        ppu.run(access.clock - clock);
+        clock = access.clock;
+
+        switch (access.kind) {
+            case Kind::READ:
+                ppu.registerRead(access.addr);
+                break;
+            case Kind::WRITE:
+                ppu.registerWrite(access.addr, access.data);
+                break;
+            case Kind::DMA:
+                ppu.dmaWrite(access.data);
+                break;
+            case Kind::CHR:
+                ppu.mapChrBank(access.addr, access.memory);
+                break;
+            case Kind::NAMETABLE:
+                ppu.mapNametable(access.addr, access.memory);
+                break;
+        }
+    }
+
+    ppu.run(end - clock);
+    clock = end;
+
+    return next;
+}
+
+bool Pipeline::banded(Frame const &frame) {
+    if (bands.empty()) return false;
+
+    // The frame has to contain all visible lines and end with them.
+    uint64_t lines = clock + renderer.dotsUntil(0, 0);
+    uint64_t end = clock + renderer.dotsUntil(239, 340) + 1;
+    if (frame.end != end || lines >= end) return false;
+
+    for (Access const &access : frame.log) {
+        if (access.clock < lines) continue;
+        if (access.kind == Kind::CHR || access.kind == Kind::NAMETABLE) return false;
+        if (access.kind == Kind::READ || access.kind == Kind::WRITE) {
+            if (access.addr == 0x2007) return false;
+        }
+    }
+
+    for (std::size_t i = 0; i < bands.size(); i++) {
+        bands[i].start = clock + renderer.dotsUntil(i * 240 / bands.size(), 0);
+        if (i > 0) bands[i - 1].end = bands[i].start;
+        bands[i].log = &frame.log;
+    }
+
+    bands.back().end = frame.end;
+
+    return true;
+}
+
+void Pipeline::replayBands(Frame const &frame) {
+    // Only keep the timing and take a snapshot at the start of each band.
+    renderer.setOutput(false);
+
+    std::size_t next = 0;
+
+    for (std::size_t i = 0; i < bands.size(); i++) {
+        Band &band = bands[i];
+        next = replay(renderer, frame.log, next, clock, band.start);
+
+        // A repeated frame is not drawn unless something changes, which is left to the renderer.
+        if (i == 0 && renderer.reused()) {
+            renderer.setOutput(true);
+            replay(renderer, frame.log, next, clock, frame.end);
+            return;
+        }
+
+        band.first = next;
+        band.ppu.snapshot(renderer);
+        band.ppu.deferCommits = true;
+        band.ppu.setOutput(true);
+
+        {
+            std::lock_guard<std::mutex> lock(bandMutex);
+            queued++;
+        }
+
+        bandChanged.notify_all();
+    }
+
+    replay(renderer, frame.log, next, clock, frame.end);
+    renderer.setOutput(true);
+
+    // The lines and the frame are committed in order once all bands are rendered.
+    std::unique_lock<std::mutex> lock(bandMutex);
+    bandChanged.wait(lock, [this] { return finished == bands.size(); });
+    queued = 0;
+    taken = 0;
+    finished = 0;
+    lock.unlock();
+
+    renderer.commit(0, 239);
+}
+
+void Pipeline::work() {
+    std::unique_lock<std::mutex> lock(bandMutex);
+
+    while (true) {
+        bandChanged.wait(lock, [this] { return quitWorkers || taken < queued; });
+        if (taken == queued) return;
+
+        Band &band = bands[taken++];
+        lock.unlock();
+
+        uint64_t clock = band.start;
+        replay(band.ppu, *band.log, band.first, clock, band.end);
+
+        lock.lock();
+        finished++;
+        bandChanged.notify_all();
+    }
+}
@@ -0,0 +1,15 @@
+#include "Profiler.h"
+
+#ifdef NES_PROFILE
+
+void profiler::Counter::add(Counter const &counter) {
+    count += counter.count;
+    nanoseconds += counter.nanoseconds;
+}
+
+void profiler::writeCounter(std::ostream &out, char const *name, Counter const &counter) {
+    out << "\"" << name << "\": {\"count\": " << counter.count;
+    out << ", \"nanoseconds\": " << counter.nanoseconds << "}";
+}
+
+#endif // NES_PROFILE
@@ -0,0 +1,25 @@
+#ifndef T_RECORDINGSCREEN
+#define T_RECORDINGSCREEN
+
+#ifndef H_RECORDINGSCREEN
+#error __FILE__ should only be included from RecordingScreen.h.
+#endif // H_RECORDINGSCREEN
+
+#include "RecordingScreen.h"
+
+template <std::size_t W, std::size_t H, typename T>
+void RecordingScreen<W, H, T>::commitFrame() {
+    // The frame is written before it is handed to the consumer.
+    if (*out) out->write((char const *)RecordingScreen::frame(), W * H * sizeof(T));
+
+    Screen<W, H, T>::commitFrame();
+}
+
+template <std::size_t W, std::size_t H, typename T>
+void RecordingScreen<W, H, T>::repeatFrame() {
+    if (*out) out->write((char const *)RecordingScreen::buffers[RecordingScreen::newest].data(), W * H * sizeof(T));
+
+    Screen<W, H, T>::repeatFrame();
+}
+
+#endif // T_RECORDINGSCREEN
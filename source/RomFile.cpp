@@ -60,10 +60,12 @@ RomFile::Type RomFile::getType() {
 }
 
 NametableLayout RomFile::getNametableLayout() {
-    if (header.ines.hasAlternativeNametable) NametableLayout::ALTERNATIVE;
-    if (header.ines.isHorizontalArrangement) NametableLayout::HORIZONTAL;
+    if (header.ines.hasAlternativeNametable) return NametableLayout::ALTERNATIVE;
 
-    return NametableLayout::VERTICAL;
+    // A horizontal arrangement of the nametables is mirrored vertically.
+    if (header.ines.isHorizontalArrangement) return NametableLayout::VERTICAL;
+
+    return NametableLayout::HORIZONTAL;
 }
 
 uint32_t RomFile::getMapperNumber() {
@@ -5,14 +5,29 @@
 #error __FILE__ should only be included from SDLScreen.h.
 #endif // H_SDLSCREEN
 
+#include <algorithm>
+#include <cmath>
 #include <SDL3/SDL_render.h>
 
 #include "Screen.h"
 #include "SDL/SDLScreen.h"
 
+template <std::size_t W, std::size_t H>
+SDLScreen<W, H>::~SDLScreen() {
+    if (texture) SDL_DestroyTexture(texture);
+}
+
 template <std::size_t W, std::size_t H>
 void SDLScreen<W, H>::draw(SDL_Renderer *renderer) {
-    typename Screen<W, H>::Buffer buffer = SDLScreen::buffers[0];
+    bool fresh = SDLScreen::acquire();
+
+    // Textures belong to a renderer, a new renderer needs a new texture with the frame.
+    if (renderer != this->renderer) {
+        if (!createTexture(renderer)) return;
+        fresh = true;
+    }
+
+    if (fresh) SDL_UpdateTexture(texture, nullptr, SDLScreen::front(), W * sizeof(typename Screen<W, H>::Pixel));
 
     // Set to screen to black.
     SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, SDL_ALPHA_OPAQUE);
@@ -26,31 +41,43 @@ void SDLScreen<W, H>::draw(SDL_Renderer *renderer) {
     // Set scale factor.
     float const SCALE_X = w / (float)W;
     float const SCALE_Y = h / (float)H;
-    float const SCALE = std::min(SCALE_X, SCALE_Y);
-    SDL_SetRenderScale(renderer, SCALE, SCALE);
-
-    // Calculate black bar offsets.
-    float const OFFSET_X = (w / SCALE - W) / 2.0;
-    float const OFFSET_Y = (h / SCALE - H) / 2.0;
-
-    // Draw pixels.
-    SDL_FRect pixel = {0.0, 0.0, 1.0, 1.0};
-    typename Screen<W, H>::RGBA color;
-
-    for (std::size_t y = 0; y < H; y++) {
-        for (std::size_t x = 0; x < W; x++) {
-            // Set pixel position.
-            pixel.x = x + OFFSET_X;
-            pixel.y = y + OFFSET_Y;
-
-            // Draw pixel.
-            color = buffer[x + y * W];
-            SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, SDL_ALPHA_OPAQUE);
-            SDL_RenderFillRect(renderer, &pixel);
-        }
-    }
+    float scale = std::min(SCALE_X, SCALE_Y);
+    if (integerScaling && scale >= 1.0) scale = std::floor(scale);
+
+    // Center the frame between black bars.
+    SDL_FRect quad;
+    quad.w = W * scale;
+    quad.h = H * scale;
+    quad.x = (w - quad.w) / 2.0;
+    quad.y = (h - quad.h) / 2.0;
 
+    SDL_RenderTexture(renderer, texture, nullptr, &quad);
     SDL_RenderPresent(renderer);
 }
 
-#endif // T_SDLSCREEN
\ No newline at end of file
+template <std::size_t W, std::size_t H>
+void SDLScreen<W, H>::setIntegerScaling(bool integerScaling) {
+    this->integerScaling = integerScaling;
+}
+
+template <std::size_t W, std::size_t H>
+bool SDLScreen<W, H>::setVSync(SDL_Renderer *renderer, int vsync) {
+    return SDL_SetRenderVSync(renderer, vsync);
+}
+
+template <std::size_t W, std::size_t H>
+bool SDLScreen<W, H>::createTexture(SDL_Renderer *renderer) {
+    if (texture) SDL_DestroyTexture(texture);
+
+    this->renderer = nullptr;
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, W, H);
+    if (!texture) return false;
+
+    // Keep the pixels sharp when scaled.
+    SDL_SetTextureScaleMode(texture, SDL_SCALEMODE_NEAREST);
+    this->renderer = renderer;
+
+    return true;
+}
+
+#endif // T_SDLSCREEN
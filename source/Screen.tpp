@@ -5,48 +5,66 @@
 #error __FILE__ should only be included from Screen.h.
 #endif // H_SCREEN
 
-#include <utility>
+#include <atomic>
 #include <algorithm>
 
 #include "Screen.h"
 
-template <std::size_t W, std::size_t H>
-void Screen<W, H>::put(std::size_t x, std::size_t y, uint8_t r, uint8_t g, uint8_t b) {
-    if (x < 0 || x >= W) return;
-    if (y < 0 || y >= H) return;
+template <std::size_t W, std::size_t H, typename T>
+inline typename Screen<W, H, T>::Pixel *Screen<W, H, T>::line(std::size_t y) {
+    return &buffers[back][y * W];
+}
+
+template <std::size_t W, std::size_t H, typename T>
+inline typename Screen<W, H, T>::Pixel *Screen<W, H, T>::frame() {
+    return buffers[back].data();
+}
+
+template <std::size_t W, std::size_t H, typename T>
+void Screen<W, H, T>::commitLine(std::size_t) {}
 
-    buffers[1][x + y * W].r = r;
-    buffers[1][x + y * W].g = g;
-    buffers[1][x + y * W].b = b;
+template <std::size_t W, std::size_t H, typename T>
+void Screen<W, H, T>::commitFrame() {
+    sequences[back] = ++committed;
+    newest = back;
+
+    // Release the pixels of the frame to the consumer and take the buffer it did not acquire.
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 0x03;
+    numbered.store(committed, std::memory_order_release);
 }
 
-template <std::size_t W, std::size_t H>
-void Screen<W, H>::put(std::size_t x, std::size_t y, std::array<uint8_t, 3> color) {
-    if (x < 0 || x >= W) return;
-    if (y < 0 || y >= H) return;
+template <std::size_t W, std::size_t H, typename T>
+void Screen<W, H, T>::repeatFrame() {
+    numbered.store(++committed, std::memory_order_release);
+}
 
-    buffers[1][x + y * W].r = color[0];
-    buffers[1][x + y * W].g = color[1];
-    buffers[1][x + y * W].b = color[2];
+template <std::size_t W, std::size_t H, typename T>
+void Screen<W, H, T>::repeatLine(std::size_t y) {
+    // The consumer never writes, so the newest frame can be read while it is presented.
+    std::copy_n(&buffers[newest][y * W], W, &buffers[back][y * W]);
 }
 
-template <std::size_t W, std::size_t H>
-std::array<uint8_t, 3> Screen<W, H>::get(std::size_t x, std::size_t y) {
-    std::array<uint8_t, 3> color{0, 0, 0};
+template <std::size_t W, std::size_t H, typename T>
+bool Screen<W, H, T>::acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
 
-    if (x < 0 || x >= W) return color;
-    if (y < 0 || y >= H) return color;
+    current = middle.exchange(current, std::memory_order_acq_rel) & 0x03;
+    return true;
+}
 
-    color[0] = buffers[1][x + y * W].r;
-    color[1] = buffers[1][x + y * W].g;
-    color[2] = buffers[1][x + y * W].b;
+template <std::size_t W, std::size_t H, typename T>
+inline typename Screen<W, H, T>::Pixel const *Screen<W, H, T>::front() {
+    return buffers[current].data();
+}
 
-    return color;
+template <std::size_t W, std::size_t H, typename T>
+inline uint64_t Screen<W, H, T>::sequence() {
+    return sequences[current];
 }
 
-template <std::size_t W, std::size_t H>
-void Screen<W, H>::swap() {
-    std::swap(buffers[0], buffers[1]);
+template <std::size_t W, std::size_t H, typename T>
+inline uint64_t Screen<W, H, T>::latest() {
+    return numbered.load(std::memory_order_acquire);
 }
 
-#endif // T_SCREEN
\ No newline at end of file
+#endif // T_SCREEN
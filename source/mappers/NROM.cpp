@@ -13,6 +13,17 @@ uint8_t NROM::ppuRead(uint16_t addr) {
     return chrrom[chrAddr(addr)];
 }
 
+uint8_t *NROM::prgPage(uint16_t addr) {
+    // Only 0x8000-0xFFFF is PRG-ROM.
+    if (addr < 0x8000 || prgrom.empty()) return nullptr;
+    return &prgrom[prgAddr(addr & 0xFF00)];
+}
+
+uint8_t *NROM::chrBank(uint16_t addr) {
+    if (chrrom.size() < 0x2000) return nullptr;
+    return &chrrom[chrAddr(addr & 0x1C00)];
+}
+
 uint16_t NROM::prgAddr(uint16_t addr) {
     if (prgrom.size() == 0x4000) return addr & 0x3FFF;
     return addr & 0x7FFF;
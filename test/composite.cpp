@@ -0,0 +1,84 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <array>
+
+#include "Composite.h"
+
+using std::uint8_t;
+
+/**
+ * COMPOSITE TEST
+ *
+ * Composites random lines with each kernel and compares the palette RAM entries and sprite 0 hits
+ * with the scalar kernel. The lines have random lengths, so the parts the SIMD kernels leave to
+ * the narrower kernels are tested as well. AVX2 is skipped if the processor does not support it.
+ */
+
+namespace {
+    constexpr std::size_t LINES = 100000;
+    constexpr std::size_t WIDTH = 256;
+
+    bool supportsAvx2() {
+        #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+        #else
+        return false;
+        #endif
+    }
+
+    // Compare kernel with the scalar kernel on random lines and return the number of mismatches.
+    std::size_t compare(char const *name, composite::Kernel kernel, std::mt19937 &random) {
+        std::array<uint8_t, WIDTH> background;
+        std::array<uint8_t, WIDTH> foreground;
+        std::array<uint8_t, WIDTH> expected;
+        std::array<uint8_t, WIDTH> output;
+        std::array<uint8_t, 0x20> paletteRam;
+        std::size_t mismatches = 0;
+
+        for (std::size_t line = 0; line < LINES; line++) {
+            for (uint8_t &entry : paletteRam) entry = random() & 0x3F;
+
+            for (std::size_t i = 0; i < WIDTH; i++) {
+                background[i] = random() & 0x0F;
+
+                // About half of the sprite pixels are transparent, the rest have random priority.
+                uint32_t bits = random();
+                foreground[i] = (bits & 0x03) ? 0x10 | (bits & 0x6F) : 0x00;
+            }
+
+            // Half of the lines are whole lines, the other half end after a random pixel.
+            std::size_t size = (line & 0x01) ? random() % (WIDTH + 1) : WIDTH;
+            uint8_t mask = (random() & 0x01) ? 0x30 : 0x3F;
+
+            bool expectedHit = composite::scalar(background.data(), foreground.data(), expected.data(), paletteRam.data(), mask, size);
+            bool hit = kernel(background.data(), foreground.data(), output.data(), paletteRam.data(), mask, size);
+
+            bool equal = hit == expectedHit;
+            for (std::size_t i = 0; i < size; i++) equal = equal && output[i] == expected[i];
+
+            if (!equal) {
+                if (mismatches == 0) std::printf("%s: line %zu of %zu pixels differs from scalar\n", name, line, size);
+                mismatches++;
+            }
+        }
+
+        std::printf("%s: %zu of %zu lines differ\n", name, mismatches, LINES);
+        return mismatches;
+    }
+}
+
+int main() {
+    std::mt19937 random(0x4E45531A);
+    std::size_t mismatches = compare("sse2", &composite::sse2, random);
+
+    if (supportsAvx2()) {
+        mismatches += compare("avx2", &composite::avx2, random);
+    } else {
+        std::printf("avx2: skipped, not supported by the processor\n");
+    }
+
+    return mismatches ? 1 : 0;
+}
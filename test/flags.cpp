@@ -0,0 +1,280 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <array>
+#include <vector>
+#include <memory>
+
+#include "Bus.h"
+#include "mappers/NROM.h"
+
+using std::uint16_t;
+using std::uint8_t;
+
+/**
+ * LAZY FLAGS TEST
+ *
+ * Runs random programs on the CPU of the bus and on an eager reference, which updates every flag
+ * of P the moment an instruction changes it, and compares them after every random instruction.
+ * The programs are made of the official instructions which read or write the flags, including 
+ * branches which skip an instruction if taken. After each random instruction the program stores
+ * A, X and Y and pushes and pulls P, so that the registers and the packed status can be read 
+ * from memory through the bus.
+ */
+
+namespace {
+    constexpr std::size_t PROGRAMS = 1000;
+    constexpr std::size_t ROUNDS = 300;
+    constexpr uint16_t START = 0x8000;
+    constexpr uint16_t SNAPSHOT = 0x0200; // A, X and Y are stored here after each round.
+
+    // Opcodes of the random instructions by their operand.
+    constexpr std::array<uint8_t, 11> IMMEDIATE = {0x09, 0x29, 0x49, 0x69, 0xE9, 0xC9, 0xE0, 0xC0, 0xA9, 0xA2, 0xA0};
+    constexpr std::array<uint8_t, 21> ZERO_PAGE = {0x05, 0x25, 0x45, 0x65, 0xE5, 0xC5, 0xE4, 0xC4, 0xA5, 0xA6, 0xA4, 0x24, 0x06, 0x46, 0x26, 0x66, 0xE6, 0xC6, 0x85, 0x86, 0x84};
+    constexpr std::array<uint8_t, 27> IMPLIED = {0x0A, 0x4A, 0x2A, 0x6A, 0x18, 0x38, 0x58, 0x78, 0xB8, 0xD8, 0xF8, 0xE8, 0xC8, 0xCA, 0x88, 0xAA, 0xA8, 0x8A, 0x98, 0xBA, 0x48, 0x68, 0x08, 0x28, 0xEA, 0xEA, 0xEA};
+    constexpr std::array<uint8_t, 8> BRANCHES = {0x10, 0x30, 0x50, 0x70, 0x90, 0xB0, 0xD0, 0xF0};
+
+    struct Reference {
+        uint8_t a = 0x00;
+        uint8_t x = 0x00;
+        uint8_t y = 0x00;
+        uint8_t s = 0x00;
+        uint8_t p = 0x00;
+        uint16_t pc = START;
+        std::array<uint8_t, 0x0800> ram = {};
+        std::vector<uint8_t> const *prg = nullptr;
+
+        uint8_t read(uint16_t addr) {
+            if (addr < 0x2000) return ram[addr & 0x07FF];
+            return (*prg)[addr & 0x7FFF];
+        }
+
+        void write(uint16_t addr, uint8_t data) {
+            ram[addr & 0x07FF] = data;
+        }
+
+        void flag(uint8_t bit, bool set) {
+            p = set ? p | bit : p & ~bit;
+        }
+
+        uint8_t nz(uint8_t value) {
+            flag(0x02, value == 0x00);
+            flag(0x80, value & 0x80);
+            return value;
+        }
+
+        void add(uint8_t value) {
+            uint16_t sum = a + value + (p & 0x01);
+            flag(0x01, sum > 0x00FF);
+            flag(0x40, ~(a ^ value) & (a ^ sum) & 0x80);
+            a = nz(sum & 0x00FF);
+        }
+
+        void compare(uint8_t reg, uint8_t value) {
+            flag(0x01, reg >= value);
+            nz(reg - value);
+        }
+
+        uint8_t shift(uint8_t opcode, uint8_t value) {
+            uint8_t carry = p & 0x01;
+
+            switch (opcode & 0xE0) {
+                case 0x00: flag(0x01, value & 0x80); return nz(value << 1); // ASL
+                case 0x20: flag(0x01, value & 0x80); return nz((value << 1) | carry); // ROL
+                case 0x40: flag(0x01, value & 0x01); return nz(value >> 1); // LSR
+                default: flag(0x01, value & 0x01); return nz((value >> 1) | (carry << 7)); // ROR
+            }
+        }
+
+        void push(uint8_t data) {
+            ram[0x0100 | s--] = data;
+        }
+
+        uint8_t pop() {
+            return ram[0x0100 | ++s];
+        }
+
+        // Run the instruction at PC.
+        void step() {
+            uint8_t opcode = read(pc++);
+            uint8_t operand = 0x00;
+            uint8_t value = 0x00;
+
+            bool zeroPage = (opcode & 0x1F) == 0x04 || (opcode & 0x1F) == 0x05 || (opcode & 0x1F) == 0x06;
+            bool absolute = (opcode & 0x1F) == 0x0C || (opcode & 0x1F) == 0x0D || (opcode & 0x1F) == 0x0E;
+            bool immediate = (opcode & 0x1F) == 0x09 || opcode == 0xA0 || opcode == 0xA2 || opcode == 0xC0 || opcode == 0xE0;
+            bool relative = (opcode & 0x1F) == 0x10;
+
+            uint16_t addr = 0x0000;
+            if (zeroPage || immediate || relative) operand = read(pc++);
+            if (zeroPage) addr = operand;
+            if (absolute) {
+                addr = read(pc) | (read(pc + 1) << 8);
+                pc += 2;
+            }
+            if (zeroPage || absolute) value = read(addr);
+            if (immediate) value = operand;
+
+            switch (opcode) {
+                case 0x09: case 0x05: a = nz(a | value); break; // ORA
+                case 0x29: case 0x25: a = nz(a & value); break; // AND
+                case 0x49: case 0x45: a = nz(a ^ value); break; // EOR
+                case 0x69: case 0x65: add(value); break; // ADC
+                case 0xE9: case 0xE5: add(value ^ 0xFF); break; // SBC
+                case 0xC9: case 0xC5: compare(a, value); break; // CMP
+                case 0xE0: case 0xE4: compare(x, value); break; // CPX
+                case 0xC0: case 0xC4: compare(y, value); break; // CPY
+                case 0xA9: case 0xA5: a = nz(value); break; // LDA
+                case 0xA2: case 0xA6: x = nz(value); break; // LDX
+                case 0xA0: case 0xA4: y = nz(value); break; // LDY
+                case 0x24: // BIT
+                    flag(0x02, (a & value) == 0x00);
+                    flag(0x40, value & 0x40);
+                    flag(0x80, value & 0x80);
+                    break;
+                case 0x06: case 0x26: case 0x46: case 0x66: write(addr, shift(opcode, value)); break;
+                case 0x0A: case 0x2A: case 0x4A: case 0x6A: a = shift(opcode, a); break;
+                case 0xE6: write(addr, nz(value + 1)); break; // INC
+                case 0xC6: write(addr, nz(value - 1)); break; // DEC
+                case 0x85: case 0x8D: write(addr, a); break; // STA
+                case 0x86: case 0x8E: write(addr, x); break; // STX
+                case 0x84: case 0x8C: write(addr, y); break; // STY
+                case 0x18: flag(0x01, false); break; // CLC
+                case 0x38: flag(0x01, true); break; // SEC
+                case 0x58: flag(0x04, false); break; // CLI
+                case 0x78: flag(0x04, true); break; // SEI
+                case 0xB8: flag(0x40, false); break; // CLV
+                case 0xD8: flag(0x08, false); break; // CLD
+                case 0xF8: flag(0x08, true); break; // SED
+                case 0xE8: x = nz(x + 1); break; // INX
+                case 0xC8: y = nz(y + 1); break; // INY
+                case 0xCA: x = nz(x - 1); break; // DEX
+                case 0x88: y = nz(y - 1); break; // DEY
+                case 0xAA: x = nz(a); break; // TAX
+                case 0xA8: y = nz(a); break; // TAY
+                case 0x8A: a = nz(x); break; // TXA
+                case 0x98: a = nz(y); break; // TYA
+                case 0xBA: x = nz(s); break; // TSX
+                case 0x9A: s = x; break; // TXS
+                case 0x48: push(a); break; // PHA
+                case 0x68: a = nz(pop()); break; // PLA
+                case 0x08: push(p | 0x30); break; // PHP
+                case 0x28: p = (pop() & 0xCF) | 0x20; break; // PLP
+                case 0xEA: break; // NOP
+                default: {
+                    // Branches test N, V, C or Z depending on the upper two bits.
+                    static constexpr std::array<uint8_t, 4> flags = {0x80, 0x40, 0x01, 0x02};
+                    bool set = p & flags[opcode >> 6];
+                    if (set == bool(opcode & 0x20)) pc += (int8_t)operand;
+                }
+            }
+        }
+    };
+
+    // Generate a random program, with the PC of the PLP ending each round in ends.
+    std::vector<uint8_t> generate(std::mt19937 &random, std::vector<uint16_t> &ends, uint16_t &stop) {
+        std::vector<uint8_t> prg(0x8000, 0xEA);
+        uint16_t pc = START;
+        auto emit = [&](std::initializer_list<uint8_t> bytes) { for (uint8_t byte : bytes) prg[pc++ & 0x7FFF] = byte; };
+
+        // Known stack and random registers and flags.
+        emit({0xA2, 0xFF, 0x9A, 0xA9, (uint8_t)random(), 0x48, 0x28});
+        emit({0xA9, (uint8_t)random(), 0xA2, (uint8_t)random(), 0xA0, (uint8_t)random()});
+
+        for (std::size_t round = 0; round < ROUNDS; round++) {
+            switch (random() % 4) {
+                case 0: emit({IMMEDIATE[random() % IMMEDIATE.size()], (uint8_t)random()}); break;
+                case 1: emit({ZERO_PAGE[random() % ZERO_PAGE.size()], (uint8_t)(random() & 0x0F)}); break;
+                case 2: emit({IMPLIED[random() % IMPLIED.size()]}); break;
+                case 3: emit({BRANCHES[random() % BRANCHES.size()], 0x02, 0xA0, (uint8_t)random()}); break;
+            }
+
+            // Store the registers and push and pull the status.
+            emit({0x8D, SNAPSHOT & 0xFF, SNAPSHOT >> 8, 0x8E, (SNAPSHOT + 1) & 0xFF, SNAPSHOT >> 8});
+            emit({0x8C, (SNAPSHOT + 2) & 0xFF, SNAPSHOT >> 8, 0x08});
+            ends.push_back(pc);
+            emit({0x28});
+        }
+
+        // Spin at the end.
+        stop = pc;
+        emit({0x4C, (uint8_t)(stop & 0xFF), (uint8_t)(stop >> 8)});
+
+        // Reset vector.
+        prg[0x7FFC] = START & 0xFF;
+        prg[0x7FFD] = START >> 8;
+
+        return prg;
+    }
+
+    // Run a random program on the bus and the reference and return if they agreed.
+    bool compare(std::size_t program, std::mt19937 &random) {
+        std::vector<uint16_t> ends;
+        uint16_t stop = 0x0000;
+        std::vector<uint8_t> prg = generate(random, ends, stop);
+
+        Bus bus;
+        bus.insertCart(std::make_shared<NROM>(prg, std::vector<uint8_t>(0x2000), NametableLayout::VERTICAL));
+
+        Reference reference;
+        reference.prg = &prg;
+
+        // Random zero page.
+        for (uint16_t addr = 0x0000; addr < 0x0800; addr++) reference.ram[addr] = bus.read(addr);
+        for (uint16_t addr = 0x0000; addr < 0x0010; addr++) {
+            reference.ram[addr] = random();
+            bus.write(addr, reference.ram[addr]);
+        }
+
+        std::size_t round = 0;
+
+        while (reference.pc != stop) {
+            uint16_t pc = reference.pc;
+            reference.step();
+            bus.stepInstruction();
+
+            // The status pushed and pulled at the end of the round is left on the stack.
+            if (round < ends.size() && pc == ends[round]) {
+                std::array<uint8_t, 4> expected = {reference.a, reference.x, reference.y, (uint8_t)(reference.p | 0x30)};
+                std::array<uint8_t, 4> actual = {
+                    bus.read(SNAPSHOT),
+                    bus.read(SNAPSHOT + 1),
+                    bus.read(SNAPSHOT + 2),
+                    bus.read(0x0100 | reference.s)
+                };
+
+                if (actual != expected) {
+                    std::printf(
+                        "program %zu round %zu: A X Y P %02X %02X %02X %02X, expected %02X %02X %02X %02X\n",
+                        program, round, actual[0], actual[1], actual[2], actual[3], expected[0], expected[1], expected[2], expected[3]
+                    );
+                    return false;
+                }
+
+                round++;
+            }
+        }
+
+        for (uint16_t addr = 0x0000; addr < 0x0010; addr++) {
+            if (bus.read(addr) != reference.ram[addr]) {
+                std::printf("program %zu: zero page %02X differs\n", program, addr);
+                return false;
+            }
+        }
+
+        return round == ends.size();
+    }
+}
+
+int main() {
+    std::mt19937 random(0x6502);
+    std::size_t failed = 0;
+
+    for (std::size_t program = 0; program < PROGRAMS; program++) {
+        if (!compare(program, random)) failed++;
+    }
+
+    std::printf("flags: %zu of %zu programs differ\n", failed, PROGRAMS);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "Bus.h"
+#include "mappers/NROM.h"
+
+using std::uint64_t;
+using std::uint16_t;
+using std::uint8_t;
+
+/**
+ * IDLE SKIP TEST
+ *
+ * Runs programs waiting for the NMI in an idle loop, a JMP to itself and a PPUSTATUS poll, with
+ * idle skip on, to random targets. The NMI transfers the sprites with DMA. Run may only pass its 
+ * target by the last instruction, or interrupt, and a DMA started by it, never by skipped 
+ * iterations of the loop.
+ */
+
+namespace {
+    constexpr uint64_t FRAMES = 200;
+    constexpr uint64_t DOTS = 341 * 262; // Dots of a frame.
+    constexpr uint64_t OVERSHOOT = (8 + 513) * 3; // Longest instruction and DMA in dots.
+    constexpr uint16_t START = 0x8000;
+    constexpr uint16_t NMI = 0x8100;
+
+    std::vector<uint8_t> generate(bool poll) {
+        std::vector<uint8_t> prg(0x8000, 0xEA);
+        uint16_t pc = START;
+        auto emit = [&](std::initializer_list<uint8_t> bytes) { for (uint8_t byte : bytes) prg[pc++ & 0x7FFF] = byte; };
+
+        // SEI, LDX #$FF, TXS, wait for vblank twice, NMI on and show the background and sprites.
+        emit({0x78, 0xA2, 0xFF, 0x9A, 0x2C, 0x02, 0x20, 0x10, 0xFB, 0x2C, 0x02, 0x20, 0x10, 0xFB});
+        emit({0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20});
+
+        // LDA $2002, BPL loop, JMP loop or JMP to itself.
+        uint16_t loop = pc;
+        if (poll) emit({0xAD, 0x02, 0x20, 0x10, 0xFB});
+        emit({0x4C, (uint8_t)(loop & 0xFF), (uint8_t)(loop >> 8)});
+
+        // NMI: OAMADDR 0, DMA from page 2, RTI.
+        pc = NMI;
+        emit({0xA9, 0x00, 0x8D, 0x03, 0x20, 0xA9, 0x02, 0x8D, 0x14, 0x40, 0x40});
+
+        prg[0x7FFA] = NMI & 0xFF;
+        prg[0x7FFB] = NMI >> 8;
+        prg[0x7FFC] = START & 0xFF;
+        prg[0x7FFD] = START >> 8;
+
+        return prg;
+    }
+
+    // Run the program to random targets and return the number of targets overshot too far.
+    std::size_t compare(char const *name, bool poll, std::mt19937 &random) {
+        Bus bus;
+        bus.insertCart(std::make_shared<NROM>(generate(poll), std::vector<uint8_t>(0x2000), NametableLayout::VERTICAL));
+        bus.setIdleSkip(true);
+
+        std::size_t failed = 0;
+        uint64_t worst = 0;
+        uint64_t target = bus.time();
+
+        while (target < FRAMES * DOTS) {
+            // Targets from a few dots to a few frames ahead.
+            target = std::max(target, bus.time()) + 1 + random() % (3 * DOTS);
+            bus.run(target);
+
+            uint64_t overshoot = bus.time() - target;
+            worst = std::max(worst, overshoot);
+            if (overshoot > OVERSHOOT) failed++;
+        }
+
+        std::printf("%s: %zu targets overshot by more than %llu dots, at most %llu dots\n", name, failed, (unsigned long long)OVERSHOOT, (unsigned long long)worst);
+        return failed;
+    }
+}
+
+int main() {
+    std::mt19937 random(0x2002);
+    std::size_t failed = compare("jmp", false, random);
+    failed += compare("poll", true, random);
+
+    return failed ? 1 : 0;
+}